@@ -27,7 +27,7 @@ class CIU {
   static os::utils::ds::HashMap<common::uint32_t, CIUColor> subsystemColorMap;
   static void SetupDefaultRoutes();
   static void SetupDefaultColors();
-  static CIURouteFlags Resolve(const CIUReport& report);
+  static CIURouteFlags Resolve(const char* subsystem, CIUSeverity severity);
   static CIUColor GetSeverityColor(CIUSeverity severity);
   static CIUColor GetSubsystemColor(const char* subsystemName);
   static common::uint32_t MakeRouteKey(const char* subsystem, CIUSeverity severity);
@@ -37,6 +37,7 @@ class CIU {
  public:
   static void Init();
   static bool IsReady();
+  static bool Accepts(const char* subsystem, CIUSeverity severity);  // a report would reach a sink
   static void Report(const CIUReport& report);
 };
 
@@ -12,6 +12,7 @@ class CIUOfficer {
  public:
   explicit CIUOfficer(const char* subsystemName);
 
+  bool accepts(CIUSeverity severity);  // check before building a report with metadata
   void send(CIUReport& report);
 
   void trace(const char* code, const char* message);
@@ -2,9 +2,8 @@
 #define __OS__CIU__REPORT_H
 
 #include <common/types.h>
-#include <utils/ds/hashmap.h>
-#include <utils/ds/linkedlist.h>
 #include <utils/ds/pair.h>
+#include <utils/string.h>
 
 namespace os {
 namespace ciu {
@@ -18,13 +17,32 @@ class CIUReport {
   const char* code;
   const char* message;
 
-  os::utils::ds::HashMap<const char*, const char*> metadataMap;
+  static const common::uint32_t MAX_METADATA = 8;
+
+  // NOTE: inline, in insertion order; a report lives on the stack of whoever logs (16 KiB task stacks,
+  // or the stack of an interrupted task), so it stays small and never allocates
+  os::utils::ds::Pair<const char*, const char*> metadata[MAX_METADATA];
+  common::uint32_t metadataCount;
 
   CIUReport(CIUSeverity severity, const char* subsystem, const char* code, const char* message)
-      : severity(severity), subsystem(subsystem), code(code), message(message) {}
+      : severity(severity), subsystem(subsystem), code(code), message(message), metadataCount(0) {}
 
+  /**
+   * [adds a key-value pair, or replaces the value of key if it is already set]
+   * NOTE: pairs beyond MAX_METADATA are dropped
+   */
   CIUReport& meta(const char* key, const char* value) {
-    metadataMap.Insert(key, value);
+    for (common::uint32_t i = 0; i < metadataCount; i++) {
+      if (os::utils::strcmp(metadata[i].key, key) == 0) {
+        metadata[i].value = value;
+        return *this;
+      }
+    }
+    if (metadataCount < MAX_METADATA) {
+      metadata[metadataCount].key = key;
+      metadata[metadataCount].value = value;
+      metadataCount++;
+    }
     return *this;
     /*
      * returning *this pointer allows for chaining.
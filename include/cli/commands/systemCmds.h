@@ -6,6 +6,8 @@
 #include <drivers/terminal.h>
 #include <drivers/timer.h>
 #include <hardwarecommunication/pci.h>
+#include <memory/heaptrace.h>
+#include <memory/slab.h>
 #include <memorymanagement.h>
 
 
@@ -60,6 +62,26 @@ class intToStr : public Command {
 };
 
 
+class heap : public Command {
+ private:
+  os::MemoryManager* memoryManager;
+
+ public:
+  heap(os::MemoryManager* memoryManager);
+  void execute(char* args) override;
+};
+
+
+#ifdef HEAP_TRACE
+class heaptrace : public Command {
+ private:
+ public:
+  heaptrace();
+  void execute(char* args) override;
+};
+#endif
+
+
 class lspci : public Command {
  private:
   os::hardwarecommunication::PeripheralComponentInterconnectController* pci;
@@ -12,6 +12,7 @@
 #include <utils/math.h>
 #include <utils/print.h>
 #include <utils/string.h>
+#include <workqueue.h>
 
 namespace os {
 namespace cli {
@@ -31,6 +32,7 @@ class Shell : public os::drivers::KeyboardEventHandler {
   char commandHistory[10][256];
   common::uint16_t bufferIndex;  // [indexer for the command buffer]
   common::uint16_t cursorIndex;  // [indexer for the cursor position]
+  volatile bool commandPending;  // [a command is queued or running on the work queue]
 
   // Command Registry
   os::utils::ds::HashMap<const char*, Command*> commandMap;
@@ -45,6 +47,7 @@ class Shell : public os::drivers::KeyboardEventHandler {
   void RegisterCommand(Command* cmd);
 
   void virtual ExecuteCommand();
+  static void ExecuteDeferred(void* shell);
 
   /**
    * @brief [fills command buffer with specifed char to specifed length ]
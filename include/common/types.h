@@ -15,6 +15,7 @@ typedef unsigned long long int uint64_t;
 
 typedef const char* string;
 typedef uint32_t size_t;  // NOTE: 32-bit OS so memory addresses are 32-bit (uint32_t)
+typedef unsigned long uintptr_t;  // holds a pointer, also when code is built for a 64-bit host (tests/)
 }  // namespace common
 }  // namespace os
 #endif
@@ -0,0 +1,32 @@
+#ifndef __OS__CPU_H
+#define __OS__CPU_H
+
+#include <common/types.h>
+
+namespace os {
+
+/**
+ * [which CPU the caller runs on, per-CPU data is an array indexed by it]
+ * e.g.:
+ * RunQueue* runQueue = &runQueues[CPU::Current()];
+ * NOTE: index 0 is the bootstrap processor, the application processors follow in the order they started
+ */
+class CPU {
+  friend class SMP;
+
+ public:
+  static const common::uint32_t MAX_CPUS = 8;
+
+ private:
+  static common::uint8_t indexByAPICID[256];
+  static volatile bool indexed;  // indexByAPICID is filled in, set before the first AP starts
+  static volatile common::uint32_t online;
+
+ public:
+  static common::uint32_t Current();  // call with interrupts disabled, or the task may migrate meanwhile
+  static common::uint32_t Count();    // CPUs online
+};
+
+}  // namespace os
+
+#endif
@@ -6,6 +6,8 @@
 #include <hardwarecommunication/interrupts.h>
 #include <hardwarecommunication/pci.h>
 #include <hardwarecommunication/port.h>
+#include <net/netbuffer.h>
+#include <spinlock.h>
 #include <utils/print.h>
 
 namespace os {
@@ -74,27 +76,68 @@ class amd_am79c973 : public Driver, public hardwarecommunication::InterruptHandl
   InitializationBlock initBlock;
 
 
+  // NOTE: the init block stores the ring lengths as log2, the card supports up to 512 descriptors
+  static const common::uint8_t MAX_RING_LOG2 = 9;
+  static const common::uint8_t DEFAULT_RING_LOG2 = 5;  // 32 descriptors
+  static const common::uint32_t BUFFER_SIZE = 2048;    // holds a full 1518 byte ethernet frame
+  static const common::uint32_t MAX_SEND_QUEUE = 256;  // packets waiting for a free send descriptor
+  static const common::uint32_t POLL_BUDGET = 16;      // receive descriptors per Poll() pass
+
+  struct Statistics {
+    common::uint32_t txPackets;   // frames handed to the card
+    common::uint32_t txQueued;    // frames that had to wait in the software queue
+    common::uint32_t txRingFull;  // sends that found every descriptor owned by the card
+    common::uint32_t txDrops;     // frames dropped (queue full, oversized or no buffer for a copy)
+    common::uint32_t rxPackets;   // frames passed to the handler
+    common::uint32_t rxErrors;    // descriptors with the ERR bit set
+    common::uint32_t rxMissed;    // CSR0 MISS, the card had no free receive descriptor
+    common::uint32_t rxPolls;     // Poll() passes that found work
+  };
+
+  // NOTE: rings and buffers are DMA memory, they come from the buddy allocator (physically contiguous)
   BufferDescriptor* sendBufferDescr;
-  common::uint8_t sendBufferDescrMemory[2048 + 15];
-  common::uint8_t sendBuffers[2 * 1024 + 15][8];
-  // common::uint8_t sendBuffers[8][2*1024+15];
-  common::uint8_t currentSendBuffer;
+  common::uint8_t* sendBuffers;   // sendRingSize * BUFFER_SIZE
+  common::uint32_t sendRingSize;  // power of two
+  common::uint32_t currentSendBuffer;
+  // NOTE: zero-copy TX, a descriptor may point straight at a pooled packet until the card is done with it
+  net::NetBuffer** sendPackets;        // sendRingSize entries
+  common::uint32_t reclaimSendBuffer;  // oldest descriptor that may still be owned by the card
+  common::uint32_t sendInFlight;       // descriptors handed to the card and not reclaimed yet
+  net::NetBufferQueue sendQueue;       // backpressure, packets waiting while the ring is full
+  // NOTE: the send ring, sendQueue and the register address port, shared by tasks on every CPU and the IRQ
+  IrqSpinlock lock;
 
 
   BufferDescriptor* recvBufferDescr;
-  common::uint8_t recvBufferDescrMemory[2048 + 15];
-  common::uint8_t recvBuffers[2 * 1024 + 15][8];
-  // common::uint8_t recvBuffers[8][2*1024+15];
-  common::uint8_t currentRecvBuffer;
+  common::uint8_t* recvBuffers;   // recvRingSize * BUFFER_SIZE
+  common::uint32_t recvRingSize;  // power of two
+  common::uint32_t currentRecvBuffer;
+  // NOTE: NAPI-style receive, the RX interrupt masks itself and Poll() drains the ring outside the IRQ
+  bool polling;
+  volatile bool pollScheduled;
+  // NOTE: the rings could not be allocated, the card is never started and the driver does nothing
+  bool dmaFailed;
+
+  Statistics statistics;
 
 
   RawDataHandler* handler;
 
 
+ private:
+  // NOTE: lock held
+  bool SendRingFull();
+  void Transmit(net::NetBuffer* packet);
+  void ReclaimSendBuffers();
+  void FlushSendQueue();
+  void Enqueue(net::NetBuffer* packet);
+
  public:
   amd_am79c973(
       hardwarecommunication::PeripheralComponentInterconnectDeviceDescriptor* dev,
-      hardwarecommunication::InterruptManager* interrupts
+      hardwarecommunication::InterruptManager* interrupts,
+      common::uint8_t sendRingLog2 = DEFAULT_RING_LOG2,
+      common::uint8_t recvRingLog2 = DEFAULT_RING_LOG2
   );
 
   ~amd_am79c973();
@@ -104,7 +147,15 @@ class amd_am79c973 : public Driver, public hardwarecommunication::InterruptHandl
   common::uint32_t HandleInterrupt(common::uint32_t esp);
 
   void Send(common::uint8_t* buffer, int size);
-  void Receive();
+  void Send(net::NetBuffer* packet);  // NOTE: takes ownership, released once transmitted (or dropped)
+  common::uint32_t Receive(common::uint32_t budget);  // returns the number of descriptors handled
+  void SetReceiveInterruptMask(bool masked);
+
+  bool Poll(common::uint32_t budget);  // true if the budget ran out and the ring may hold more
+  static void PollDeferred(void* driver);
+  bool PollPending();
+  void SetPolling(bool polling);
+  Statistics* GetStatistics();
 
   void SetHandler(RawDataHandler* handler);
   common::uint64_t GetMACAddress();
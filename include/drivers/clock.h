@@ -0,0 +1,64 @@
+#ifndef __OS__DRIVERS__CLOCK_H
+#define __OS__DRIVERS__CLOCK_H
+
+#include <common/types.h>
+#include <drivers/timer.h>
+#include <hardwarecommunication/port.h>
+#include <utils/print.h>
+
+namespace os {
+namespace drivers {
+
+/**
+ * [monotonic nanosecond clock]
+ * the TSC, calibrated at boot against PIT channel 2 (the speaker channel, channel 0 keeps ticking).
+ * cycles are converted with a multiply and a shift, ns = (cycles * mult) >> shift, there is no 64-bit
+ * division in the kernel. without a TSC (or if the calibration fails) it falls back to the PIT ticks.
+ * e.g.:
+ * uint64_t start = Clock::activeClock->GetNanoseconds();
+ * ...
+ * uint64_t elapsed = Clock::activeClock->GetNanoseconds() - start;
+ */
+class Clock {
+ public:
+  static const common::uint32_t CALIBRATION_MS = 50;
+  static const common::uint32_t SHIFT = 22;
+
+ private:
+  hardwarecommunication::Port8Bit pitChannel2Port;
+  hardwarecommunication::Port8Bit pitCommandPort;
+  hardwarecommunication::Port8Bit speakerPort;  // bit 0 := channel 2 gate, bit 5 := channel 2 output
+
+  ProgrammableIntervalTimer* pit;
+  bool tsc;
+  common::uint32_t tscKHz;
+  common::uint32_t mult;  // ns per cycle << SHIFT
+  common::uint64_t baseCycles;
+  common::uint32_t nsPerTick;  // fallback
+
+  common::uint64_t CalibrateCycles();  // TSC cycles per CALIBRATION_MS, 0 if it failed
+
+ public:
+  static Clock* activeClock;
+
+  Clock(ProgrammableIntervalTimer* pit);
+  ~Clock();
+
+  static inline common::uint64_t ReadTSC() {
+    common::uint32_t low, high;
+    asm volatile("rdtsc" : "=a"(low), "=d"(high));
+    return ((common::uint64_t)high << 32) | low;
+  }
+
+  common::uint64_t GetNanoseconds();  // since boot (calibration), never goes backwards
+  common::uint64_t CyclesToNanoseconds(common::uint64_t cycles);
+  void Delay(common::uint32_t nanoseconds);  // busy wait, for short hardware delays only
+
+  bool HasTSC();
+  common::uint32_t GetTSCFrequencyKHz();  // 0 := no TSC
+};
+
+}  // namespace drivers
+}  // namespace os
+
+#endif
@@ -3,6 +3,7 @@
 
 #include <common/types.h>
 #include <hardwarecommunication/port.h>
+#include <spinlock.h>
 #include <utils/print.h>
 
 namespace os {
@@ -24,7 +25,13 @@ class Terminal {
 
   common::uint16_t viewOffset;  // offset for ring buffer, determines which line is at the top of screen
 
+  // NOTE: buffer, cursor and view; printf runs in tasks on every CPU and in interrupt handlers
+  IrqSpinlock lock;
+
+  // NOTE: lock held
   void Render();
+  void EraseLast();
+  void SnapToBottom();
 
  public:
   Terminal();
@@ -4,6 +4,7 @@
 #include <common/types.h>
 #include <hardwarecommunication/interrupts.h>
 #include <hardwarecommunication/port.h>
+#include <timerwheel.h>
 #include <utils/print.h>
 
 namespace os {
@@ -13,15 +14,28 @@ class ProgrammableIntervalTimer : public hardwarecommunication::InterruptHandler
  private:
   hardwarecommunication::Port8Bit dataPort;
   hardwarecommunication::Port8Bit commandPort;
+  common::uint32_t frequency;
+  TimerWheel timerWheel;  // advanced by every tick
 
  public:
+  static ProgrammableIntervalTimer* activeTimer;
+
   ProgrammableIntervalTimer(hardwarecommunication::InterruptManager* interrupts, common::uint32_t frequency);
   ~ProgrammableIntervalTimer();
 
   common::uint64_t ticks;  // [tracks how many "ticks" have passed since boot]
 
   common::uint32_t HandleInterrupt(common::uint32_t esp) override;
-  void Wait(common::uint32_t milliseconds);
+  void Tick(common::uint32_t elapsed);  // IRQ0, or the Local APIC timer once it took over
+  common::uint32_t GetTicksUntilNextEvent();  // next sleeper or kernel timer, 0xFFFFFFFF := none
+  void Wait(common::uint32_t milliseconds);   // NOTE: sleeps, other tasks run meanwhile
+  void Sleep(common::uint32_t milliseconds);  // same as Wait()
+  common::uint32_t MillisecondsToTicks(common::uint32_t milliseconds);  // rounded up
+  common::uint32_t GetFrequency();
+
+  void AddTimer(Timer* timer, common::uint32_t milliseconds);  // callback runs as deferred work
+  bool CancelTimer(Timer* timer);
+  TimerWheel* GetTimerWheel();
 };
 
 }  // namespace drivers
@@ -0,0 +1,65 @@
+#ifndef __OS__FPU_H
+#define __OS__FPU_H
+
+#include <common/types.h>
+#include <cpu.h>
+#include <hardwarecommunication/interrupts.h>
+#include <multitasking.h>
+
+namespace os {
+
+/**
+ * [x87/SSE state of the tasks, restored lazily on the first FPU instruction after a switch]
+ * every switch sets CR0.TS, so the first x87/MMX/SSE instruction a task runs afterwards traps with #NM
+ * (exception 0x07). the handler clears TS and loads the task's FXSAVE area, unless the registers still
+ * hold its state from its last run on this CPU. a task that never touches the FPU never costs a save or
+ * a restore.
+ * the state of a task that did use the FPU is saved when it is switched out (not when the next FPU user
+ * traps): it may continue on another CPU, and its registers can only be read on this one.
+ * kernel code that uses SIMD (memcpy, checksums, ...) brackets it with Begin()/End(), that works in
+ * interrupt handlers and the idle context too:
+ * e.g.:
+ * uint32_t eflags = FPU::Begin();
+ * asm volatile("movdqu (%0), %%xmm0; movdqu %%xmm0, (%1)" : : "r"(src), "r"(dst) : "memory");
+ * FPU::End(eflags);
+ * NOTE: the compiler never emits SSE on its own (see the Makefile), only code between Begin() and End()
+ * may use it
+ */
+class FPU : public hardwarecommunication::InterruptHandler {
+ private:
+  struct PerCPU {
+    Task* owner;    // task whose state is in the registers, 0 := none (or clobbered by kernel use)
+    bool enabled;   // CR0.TS clear, the code running may use the FPU without a trap
+    bool borrowed;  // enabled by a trap outside of a task, TS is set again once the interrupt is done
+  };
+
+  static PerCPU perCPU[CPU::MAX_CPUS];
+  static bool hasFXSR;  // FXSAVE/FXRSTOR, FNSAVE/FRSTOR otherwise
+  static bool hasSSE;
+
+  static void Save(Task* task);
+  static void Restore(Task* task);
+  static void Reset();  // default control words, for a task's first FPU instruction
+
+ public:
+  static FPU* activeFPU;
+
+  FPU(hardwarecommunication::InterruptManager* interruptManager);
+  ~FPU();
+
+  common::uint32_t HandleInterrupt(common::uint32_t esp) override;  // #NM
+
+  static void InitCPU();  // CR0/CR4 of the calling CPU, the constructor does the bootstrap processor
+  static bool HasSSE();   // false until InitCPU() has enabled it
+
+  static void SwitchFrom(Task* previous);  // scheduler, with interrupts disabled
+  static void LeaveInterrupt();            // outermost interrupt done, ends a borrow
+  static void Forget(Task* task);          // the task is freed
+
+  static common::uint32_t Begin();  // kernel SIMD, disables interrupts, returns the EFLAGS for End()
+  static void End(common::uint32_t eflags);
+};
+
+}  // namespace os
+
+#endif
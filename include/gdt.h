@@ -32,6 +32,8 @@ class GlobalDescriptorTable {
   GlobalDescriptorTable();
   ~GlobalDescriptorTable();
 
+  void Load();  // every application processor loads the same table
+
   common::uint16_t CodeSegmentSelector();
   common::uint16_t DataSegmentSelector();
 };
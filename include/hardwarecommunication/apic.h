@@ -0,0 +1,85 @@
+#ifndef __OS__HARDWARECOMMUNICATION__APIC_H
+#define __OS__HARDWARECOMMUNICATION__APIC_H
+
+#include <common/types.h>
+#include <cpu.h>
+#include <hardwarecommunication/interrupts.h>
+#include <utils/print.h>
+
+namespace os {
+namespace drivers {
+class ProgrammableIntervalTimer;
+}
+
+namespace hardwarecommunication {
+
+/**
+ * [the CPU's Local APIC and its one-shot timer]
+ * once started, the timer drives the kernel tick (ProgrammableIntervalTimer::Tick(), same rate) instead
+ * of PIT IRQ0, which gets masked at the PIC. the other IRQs still come from the 8259 PIC through LINT0
+ * (virtual wire mode).
+ * tickless idle: EnterIdle() arms the timer for the next sleeper or kernel timer, the ticks slept
+ * through are credited in one go by the interrupt that ends the idle period.
+ * every CPU has its own Local APIC at the same address, the application processors run their timer at
+ * the bootstrap processor's rate for their time slices (InitAP()), the kernel tick stays on CPU 0.
+ */
+class LocalAPIC : public InterruptHandler {
+ public:
+  static const common::uint8_t TIMER_INTERRUPT = 0x20;  // vector hardwareInterruptOffset + 0x20
+  static const common::uint8_t SPURIOUS_VECTOR = 0xFF;
+
+ private:
+  static const common::uint32_t REGISTER_ID = 0x020;
+  static const common::uint32_t REGISTER_TPR = 0x080;
+  static const common::uint32_t REGISTER_EOI = 0x0B0;
+  static const common::uint32_t REGISTER_SPURIOUS = 0x0F0;
+  static const common::uint32_t REGISTER_ICR_LOW = 0x300;
+  static const common::uint32_t REGISTER_ICR_HIGH = 0x310;
+  static const common::uint32_t REGISTER_LVT_TIMER = 0x320;
+  static const common::uint32_t REGISTER_LVT_LINT0 = 0x350;
+  static const common::uint32_t REGISTER_LVT_LINT1 = 0x360;
+  static const common::uint32_t REGISTER_TIMER_INITIAL = 0x380;
+  static const common::uint32_t REGISTER_TIMER_CURRENT = 0x390;
+  static const common::uint32_t REGISTER_TIMER_DIVIDE = 0x3E0;
+
+  volatile common::uint32_t* registers;  // 4 KiB MMIO page, 0 := no Local APIC
+  InterruptManager* interrupts;
+  drivers::ProgrammableIntervalTimer* pit;
+
+  common::uint32_t countPerTick;                // timer counts per kernel tick, 0 := timer not running
+  common::uint32_t armedTicks[CPU::MAX_CPUS];  // kernel ticks the armed count stands for
+  volatile bool idle[CPU::MAX_CPUS];           // armed further than the next tick by EnterIdle()
+  volatile common::uint32_t idleUntil;         // CPU 0 idle: the kernel tick its armed count ends at
+
+  common::uint32_t Read(common::uint32_t reg);
+  void Write(common::uint32_t reg, common::uint32_t value);
+  void Credit(common::uint32_t elapsed);  // kernel tick on CPU 0, time slices only elsewhere
+
+ public:
+  static LocalAPIC* activeLocalAPIC;
+
+  LocalAPIC(InterruptManager* interrupts);
+  ~LocalAPIC();
+
+  common::uint32_t HandleInterrupt(common::uint32_t esp) override;
+
+  bool IsPresent();
+  common::uint8_t GetID();
+  void EndOfInterrupt();
+
+  bool StartTimer(drivers::ProgrammableIntervalTimer* pit);  // false: the PIT keeps the tick
+  bool IsTimerRunning();
+  void InitAP();  // on an application processor, enables its Local APIC and timer
+
+  void SendIPI(common::uint8_t apicID, common::uint32_t command);  // command := ICR low dword
+
+  void EnterIdle();  // idle loop, call with interrupts disabled right before "sti; hlt"
+  void ExitIdle();   // any other interrupt, catches the tick up
+  bool IsIdle(common::uint32_t cpu);
+  common::uint32_t GetIdleUntil();
+};
+
+}  // namespace hardwarecommunication
+}  // namespace os
+
+#endif
@@ -3,6 +3,7 @@
 
 
 #include <common/types.h>
+#include <cpu.h>
 #include <gdt.h>
 #include <hardwarecommunication/port.h>
 #include <multitasking.h>
@@ -14,6 +15,20 @@ namespace hardwarecommunication {
 
 class InterruptManager;
 
+/**
+ * [saves EFLAGS and disables interrupts, pair with RestoreInterrupts() for a short critical section]
+ * nests correctly: restoring brings back whatever interrupt state the caller had
+ */
+inline os::common::uint32_t SaveInterrupts() {
+  os::common::uint32_t eflags;
+  asm volatile("pushf; pop %0; cli" : "=r"(eflags) : : "memory");
+  return eflags;
+}
+
+inline void RestoreInterrupts(os::common::uint32_t eflags) {
+  asm volatile("push %0; popf" : : "r"(eflags) : "memory", "cc");
+}
+
 class InterruptHandler {
  protected:
   InterruptHandler(InterruptManager* interruptManager, os::common::uint8_t InterruptNumber);
@@ -30,7 +45,29 @@ class InterruptHandler {
 class InterruptManager {
   friend class InterruptHandler;
 
+ public:
+  static const os::common::uint32_t MAX_DEFERRED_WORK = 256;    // power of two
+  static const os::common::uint32_t DEFERRED_WORK_BUDGET = 64;  // items per RunDeferredWork() call
+
  protected:
+  struct DeferredWork {
+    void (*function)(void*);
+    void* argument;
+  };
+
+  // NOTE: bottom halves, queued by handlers and run after the EOI with interrupts enabled. every CPU has
+  // its own queue and runs what it queued itself.
+  struct PerCPU {
+    DeferredWork deferredWork[MAX_DEFERRED_WORK];
+    os::common::uint32_t deferredHead;    // next item to run
+    os::common::uint32_t deferredTail;    // next free slot
+    bool runningDeferredWork;             // a drain is in progress further down the stack
+    os::common::uint32_t interruptDepth;  // nested DoHandleInterrupt() calls
+  };
+
+  PerCPU perCPU[CPU::MAX_CPUS];
+  os::common::uint32_t deferredDropped;
+
   static InterruptManager* ActiveInterruptManager;
   InterruptHandler* handlers[256];
   TaskManager* taskManager;
@@ -78,6 +115,8 @@ class InterruptManager {
   static void HandleInterruptRequest0x0D();
   static void HandleInterruptRequest0x0E();
   static void HandleInterruptRequest0x0F();
+  static void HandleInterruptRequest0x20();  // Local APIC timer
+  static void HandleInterruptRequest0x21();  // reschedule IPI
   static void HandleInterruptRequest0x31();
 
   static void HandleInterruptRequest0x80();
@@ -122,6 +161,15 @@ class InterruptManager {
   os::common::uint16_t HardwareInterruptOffset();
   void Activate();
   void Deactivate();
+  void LoadInterruptDescriptorTable();  // the constructor does it for the bootstrap processor
+
+  static bool Defer(void (*function)(void*), void* argument);  // false if the queue is full
+  static bool InInterrupt();  // true inside a handler or deferred work, which must not block
+  static os::common::uint32_t InterruptDepth();  // on the calling CPU, deferred work adds one
+  void SetIRQMask(os::common::uint8_t irq, bool masked);  // at the 8259 PIC
+  bool HasDeferredWork();
+  void RunDeferredWork();
+  os::common::uint32_t GetDeferredDropped();
 };
 }  // namespace hardwarecommunication
 }  // namespace os
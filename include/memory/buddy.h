@@ -0,0 +1,66 @@
+#ifndef __OS__MEMORY__BUDDY_H
+#define __OS__MEMORY__BUDDY_H
+
+#include <common/types.h>
+#include <memory/frameallocator.h>
+
+namespace os {
+namespace memory {
+
+/**
+ * [binary buddy allocator for large, aligned and physically contiguous buffers (DMA rings, disk buffers)]
+ * blocks are 4 KiB << order, order 0 (4 KiB) up to MAX_ORDER (4 MiB).
+ * the arena is taken from the frame allocator 4 MiB aligned, so every block of order k is also
+ * physically aligned to its own size (4 KiB << k).
+ */
+class BuddyAllocator {
+ public:
+  static const common::uint32_t PAGE_SIZE = PhysicalFrameAllocator::FRAME_SIZE;
+  static const common::uint32_t MAX_ORDER = 10;  // 4 KiB << 10 = 4 MiB
+  static const common::uint32_t NUM_ORDERS = MAX_ORDER + 1;
+  static const common::uint32_t MAX_BLOCK_SIZE = PAGE_SIZE << MAX_ORDER;
+
+ private:
+  struct FreeBlock {  // NOTE: lives inside the free block itself, no extra memory needed
+    FreeBlock* next;
+    FreeBlock* prev;
+  };
+
+  // NOTE: one byte per page of the arena, only meaningful for the first page of a block
+  static const common::uint8_t PAGE_FREE = 0x80;       // block is on a free list
+  static const common::uint8_t PAGE_ORDER_MASK = 0x1F;  // order of the block
+
+  common::uint32_t base;   // physical start of the arena, MAX_BLOCK_SIZE aligned
+  common::uint32_t pages;  // arena size in pages
+  common::uint8_t* pageMap;
+
+  FreeBlock* freeLists[NUM_ORDERS];
+  common::uint32_t freeListBitmap;  // bit k is set when freeLists[k] is non-empty
+  common::uint32_t freePages;
+
+  void Push(common::uint32_t address, common::uint32_t order);
+  void Remove(common::uint32_t address, common::uint32_t order);
+
+ public:
+  static BuddyAllocator* activeBuddyAllocator;
+
+  BuddyAllocator(PhysicalFrameAllocator* frames, common::uint32_t arenaSize);
+  ~BuddyAllocator();
+
+  static common::uint32_t OrderOf(common::uint32_t size);  // smallest order whose blocks hold size bytes
+
+  common::uint32_t Alloc(common::uint32_t order);  // returns physical address, 0 if out of memory
+  void Free(common::uint32_t address);
+
+  // NOTE: align must be a power of two <= MAX_BLOCK_SIZE, the memory is not cleared
+  void* AllocContiguous(common::uint32_t size, common::uint32_t align = PAGE_SIZE);
+  void FreeContiguous(void* ptr);
+
+  common::uint32_t GetArenaSize();
+  common::uint32_t GetFreeBytes();
+};
+
+}  // namespace memory
+}  // namespace os
+
+#endif
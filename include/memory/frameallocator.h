@@ -0,0 +1,55 @@
+#ifndef __OS__MEMORY__FRAMEALLOCATOR_H
+#define __OS__MEMORY__FRAMEALLOCATOR_H
+
+#include <common/types.h>
+#include <multiboot.h>
+
+namespace os {
+namespace memory {
+
+/**
+ * [bitmap allocator for 4 KiB physical page frames]
+ * one bit per frame of the 4 GiB physical address space (bit set := frame used/reserved).
+ * the bitmap starts out all reserved, only the "available" ranges of the multiboot memory map are
+ * released, then low memory (< 1 MiB), the kernel image and the multiboot structures are reserved again.
+ * so memory holes and reserved ranges are never handed out.
+ */
+class PhysicalFrameAllocator {
+ public:
+  static const common::uint32_t FRAME_SIZE = 4096;
+  static const common::uint32_t MAX_FRAMES = 1024 * 1024;  // 4 GiB / 4 KiB
+
+ private:
+  static common::uint32_t bitmap[MAX_FRAMES / 32];  // NOTE: 128 KiB, lives in .bss
+
+  common::uint32_t totalFrames;  // frames reported as available by the memory map
+  common::uint32_t freeFrames;
+  common::uint32_t searchHint;  // bitmap word to start the next search at
+
+  void MarkUsed(common::uint32_t frame);
+  void MarkFree(common::uint32_t frame);
+  bool IsUsed(common::uint32_t frame);
+
+  void ReleaseRange(common::uint64_t base, common::uint64_t length);
+  void ReserveRange(common::uint32_t base, common::uint32_t length);
+
+ public:
+  static PhysicalFrameAllocator* activeFrameAllocator;
+
+  PhysicalFrameAllocator(const void* multiboot_structure);
+  ~PhysicalFrameAllocator();
+
+  common::uint32_t AllocFrame();  // returns physical address, 0 if out of memory
+  // physically contiguous, alignment in frames, 0 if none
+  common::uint32_t AllocFrames(common::uint32_t count, common::uint32_t alignment = 1);
+  void FreeFrame(common::uint32_t address);
+  void FreeFrames(common::uint32_t address, common::uint32_t count);
+
+  common::uint32_t GetTotalFrames();
+  common::uint32_t GetFreeFrames();
+};
+
+}  // namespace memory
+}  // namespace os
+
+#endif
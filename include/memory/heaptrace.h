@@ -0,0 +1,62 @@
+#ifndef __OS__MEMORY__HEAPTRACE_H
+#define __OS__MEMORY__HEAPTRACE_H
+
+#include <common/types.h>
+#include <spinlock.h>
+
+namespace os {
+namespace memory {
+
+struct HeapTraceEntry {  // NOTE: 16 bytes per live allocation
+  void* ptr;                  // 0 := empty slot
+  common::uint32_t callsite;  // return address of the operator new caller
+  common::uint32_t size;
+  common::uint32_t tick;  // timer tick of the allocation
+};
+
+struct HeapTraceCallsite {
+  common::uint32_t callsite;
+  common::uint32_t bytes;        // live bytes allocated from this callsite
+  common::uint32_t allocations;  // live allocations from this callsite
+  common::uint32_t oldestTick;   // oldest live allocation, old entries that never go away are leak suspects
+};
+
+/**
+ * [opt-in allocation tracer, build with "make HEAP_TRACE=1"]
+ * operator new records (callsite, size, tick) of every live allocation in a fixed side table,
+ * operator delete removes it again. the table is open addressed on the pointer, so both are O(1)
+ * and the tracer itself never allocates from the heap.
+ * without HEAP_TRACE the hooks are compiled out and the table does not exist.
+ * NOTE: own lock, new/delete run in tasks on every CPU, in interrupt handlers and in deferred work
+ */
+class HeapTrace {
+ public:
+  static const common::uint32_t MAX_ENTRIES = 4096;  // power of two, 64 KiB side table
+  static const common::uint32_t MAX_CALLSITES = 128;
+
+ private:
+  static HeapTraceEntry entries[MAX_ENTRIES];
+  static common::uint32_t liveEntries;
+  static common::uint32_t dropped;  // allocations not recorded because the table was full
+  static volatile common::uint64_t* clock;
+  static IrqSpinlock lock;
+
+  static common::uint32_t Slot(void* ptr);
+
+ public:
+  static void SetClock(volatile common::uint64_t* ticks);  // e.g. &timer.ticks
+
+  static void Record(void* ptr, common::uint32_t size, void* callsite);
+  static void Forget(void* ptr);
+
+  // fills callsites with the live allocations grouped by callsite, sorted by bytes (largest first)
+  static common::uint32_t GetCallsites(HeapTraceCallsite* callsites, common::uint32_t maxCallsites);
+  static common::uint32_t GetLiveEntries();
+  static common::uint32_t GetDropped();
+  static common::uint32_t Now();
+};
+
+}  // namespace memory
+}  // namespace os
+
+#endif
@@ -0,0 +1,71 @@
+#ifndef __OS__MEMORY__PAGING_H
+#define __OS__MEMORY__PAGING_H
+
+#include <common/types.h>
+#include <hardwarecommunication/interrupts.h>
+#include <memory/frameallocator.h>
+#include <multitasking.h>
+
+namespace os {
+namespace memory {
+
+/**
+ * [two-level i386 paging: one page directory, 4 KiB page tables and PSE 4 MiB large pages]
+ * the whole 4 GiB are identity mapped (virtual == physical) with 4 MiB pages, so the kernel, the heap,
+ * DMA buffers and MMIO need one TLB entry per 4 MiB instead of 1024.
+ * only the first 4 MiB use a page table, there page 0 is left unmapped to catch null pointers.
+ * CPUs without PSE get 4 KiB pages everywhere, CPUs without PGE get no global entries (CPUID.1:EDX).
+ */
+class Paging {
+ public:
+  static const common::uint32_t PAGE_SIZE = 4096;
+  static const common::uint32_t LARGE_PAGE_SIZE = 4 * 1024 * 1024;
+
+  // NOTE: entry flags, the same bits are used by page directory and page table entries
+  static const common::uint32_t PAGE_PRESENT = 1 << 0;
+  static const common::uint32_t PAGE_WRITABLE = 1 << 1;
+  static const common::uint32_t PAGE_USER = 1 << 2;
+  static const common::uint32_t PAGE_CACHE_DISABLE = 1 << 4;
+  static const common::uint32_t PAGE_LARGE = 1 << 7;   // directory entry maps 4 MiB directly (PSE)
+  static const common::uint32_t PAGE_GLOBAL = 1 << 8;  // survives CR3 reloads (PGE)
+
+ private:
+  PhysicalFrameAllocator* frames;
+  common::uint32_t* pageDirectory;  // 1024 entries, one 4 KiB frame
+
+  static bool hasPSE;  // CPUID.1:EDX bit 3, 4 MiB pages
+  static bool hasPGE;  // CPUID.1:EDX bit 13, global pages
+
+  common::uint32_t* GetPageTable(common::uint32_t virtualAddress, bool create);
+  static void InvalidatePage(common::uint32_t virtualAddress);
+
+ public:
+  static Paging* activePaging;
+
+  Paging(PhysicalFrameAllocator* frames);
+  ~Paging();
+
+  void Activate();  // loads CR3 and turns on PSE, PGE (if present) and paging
+
+  bool MapPage(common::uint32_t virtualAddress, common::uint32_t physicalAddress, common::uint32_t flags);
+  void UnmapPage(common::uint32_t virtualAddress);
+  common::uint32_t GetPhysicalAddress(common::uint32_t virtualAddress);  // 0 if not mapped
+};
+
+
+/**
+ * [exception 0x0E, prints the faulting address (CR2) and the reason, then halts]
+ * NOTE: a page fault is always fatal, there is no demand paging or stack growth
+ */
+class PageFaultHandler : public hardwarecommunication::InterruptHandler {
+ public:
+  PageFaultHandler(hardwarecommunication::InterruptManager* interruptManager);
+  ~PageFaultHandler();
+
+  virtual common::uint32_t HandleInterrupt(common::uint32_t esp);
+};
+
+}  // namespace memory
+}  // namespace os
+
+#endif
@@ -0,0 +1,83 @@
+#ifndef __OS__MEMORY__SLAB_H
+#define __OS__MEMORY__SLAB_H
+
+#include <common/types.h>
+#include <memorymanagement.h>
+#include <spinlock.h>
+
+namespace os {
+namespace memory {
+
+struct SlabCacheStats {
+  common::size_t objectSize;       // size of one object slot (object size rounded up to the alignment)
+  common::uint32_t slabs;          // number of slabs taken from the heap
+  common::uint32_t totalObjects;   // object slots across all slabs
+  common::uint32_t activeObjects;  // object slots currently handed out
+  common::uint32_t allocations;    // lifetime calls to Alloc() that succeeded
+  common::uint32_t frees;          // lifetime calls to Free()
+  common::uint32_t failures;       // Alloc() calls that failed because the heap was exhausted
+};
+
+/**
+ * [object cache for many objects of the same size and alignment]
+ * objects are carved out of slabs taken from MemoryManager and recycled through a free list,
+ * so Alloc()/Free() are O(1) and never walk or fragment the general-purpose heap.
+ * slabs are only returned to the heap when the cache is destroyed.
+ * Alloc()/Free() may be called from any CPU and from interrupt handlers.
+ *
+ * e.g.:
+ * SlabCache nodeCache("hashnode", sizeof(Node));
+ * Node* node = new (nodeCache.Alloc()) Node;
+ * nodeCache.Free(node);
+ */
+class SlabCache {
+ private:
+  struct Slab {
+    Slab* next;
+  };
+  struct FreeObject {
+    FreeObject* next;
+  };
+
+  const char* name;
+  common::size_t objectSize;
+  common::size_t alignment;
+  common::size_t stride;  // distance between two object slots inside a slab
+  common::uint32_t objectsPerSlab;
+
+  Slab* slabs;           // every slab owned by this cache
+  FreeObject* freeList;  // free object slots across all slabs
+  SlabCacheStats stats;
+  IrqSpinlock lock;  // NOTE: protects the free list, the slabs and the stats
+
+  // [registry of every live cache, used by the shell to print per-cache statistics]
+  static SlabCache* firstCache;
+  SlabCache* nextCache;
+
+  bool Grow();  // lock held
+
+ public:
+  static const common::uint32_t DEFAULT_OBJECTS_PER_SLAB = 32;
+
+  SlabCache(
+      const char* name,
+      common::size_t objectSize,
+      common::size_t alignment = MemoryManager::ALIGNMENT,
+      common::uint32_t objectsPerSlab = DEFAULT_OBJECTS_PER_SLAB
+  );
+  ~SlabCache();
+
+  void* Alloc();
+  void Free(void* ptr);
+
+  const char* GetName();
+  SlabCacheStats GetStats();
+
+  static SlabCache* First();
+  SlabCache* Next();
+};
+
+}  // namespace memory
+}  // namespace os
+
+#endif
@@ -2,38 +2,107 @@
 #define __OS__MEMORYMANAGEMENT_H
 
 #include <common/types.h>
+#include <spinlock.h>
 
 namespace os {
 
+namespace memory {
+class PhysicalFrameAllocator;
+}
+
 struct MemoryChunk {  // NOTE: MemoryChunk stores metadata and the actual size allocated
   // NOTE: sizeof(MemoryChunk) := metadata + size_t size
-  MemoryChunk* next;
-  MemoryChunk* prev;
+  MemoryChunk* next;  // physical neighbour after this chunk
+  MemoryChunk* prev;  // physical neighbour before this chunk (boundary tag used for coalescing)
   bool allocated;
   common::size_t size;  // NOTE: memory addresses in a 32-bit OS are 32 bits, hence, size_t = uint32_t
+
+  // NOTE: only valid while the chunk is free, links the chunk into its size-class bin
+  MemoryChunk* nextFree;
+  MemoryChunk* prevFree;
   /* NOTE:
       - the metadata is not a part of the size of the MemoryChunk
-      - for example: malloc(size_t: 10); // allocate uint32_t * 10 = 320 bytes
-      - this will make the "size_t size = 10 (320 bytes)", but the actual sizeof(MemoryChunk) = metadata
+      - for example: malloc(size_t: 10); // allocate 10 bytes (rounded up to 16 for alignment)
+      - this will make the "size_t size = 16", but the actual sizeof(MemoryChunk) = metadata
      + size_t size
   */
 
   /* DIAGRAM:
                          DIAGRAM OF MEMORYCHUNK:
 
-     chunk := [| *next | *prev | bool allocated |     ...  size_t size  ...    |]
-     bytes := [|   4   |   4   |       4        |     bytes to be allocated    |]
+     chunk := [| *next | *prev | bool allocated | size | *nextFree | *prevFree |  ...  payload  ...  |]
+     bytes := [|   4   |   4   |       4        |  4   |     4     |     4     |  bytes allocated  |]
   */
 };
 
+struct HeapStats {
+  common::size_t heapSize;             // bytes of all heap regions, chunk headers included
+  common::size_t bytesAllocated;       // payload bytes of allocated chunks
+  common::size_t bytesFree;            // payload bytes of free chunks
+  common::uint32_t allocatedChunks;
+  common::uint32_t freeChunks;
+  common::size_t largestFreeBlock;     // biggest single allocation that succeeds without growing
+  common::uint32_t fragmentation;      // percent of free bytes outside the largest free block
+  common::size_t peakBytesAllocated;   // high-water mark of bytesAllocated
+  common::uint32_t peakAllocatedChunks;
+  common::uint32_t allocations;        // lifetime calls to malloc() that succeeded
+  common::uint32_t frees;              // lifetime calls to free()
+  common::uint32_t failures;           // malloc() calls that returned 0
+  common::uint32_t regions;            // regions added to the heap (initial region and every Grow())
+};
+
 class MemoryManager {
+ public:
+  static const common::uint32_t NUM_BINS = 32;        // one bin per power of two, bin i := [2^i, 2^(i+1))
+  static const common::size_t ALIGNMENT = 8;          // every payload is 8-byte aligned
+  static const common::size_t MIN_SPLIT_PAYLOAD = 8;  // smallest free chunk worth splitting off
+  static const common::uint32_t GROW_MIN_PAGES = 16;   // grow by at least 64 KiB to amortize growth
+
  protected:
   MemoryChunk* first;  // pointer to first MemoryChunk (entire memory space initially)
+  MemoryChunk* last;   // pointer to the last MemoryChunk, new regions are linked in after it
+
+  memory::PhysicalFrameAllocator* frames;  // source of new pages when the heap runs out, may be 0
+
+  /** [segregated free lists, bins[i] holds free chunks with size in [2^i, 2^(i+1))] */
+  MemoryChunk* bins[NUM_BINS];
+  common::uint32_t binBitmap;  // bit i is set when bins[i] is non-empty
+  /* DIAGRAM:
+                         DIAGRAM OF THE BINS:
+
+     bin       := [|  ...  |     14      |     13      |     12      |  ...  |  0  |]
+     sizes     := [|  ...  | 16 KB-32 KB | 8 KB-16 KB  |  4 KB-8 KB  |  ...  | 1 B |]
+     binBitmap := [|  ...  |      1      |      0      |      1      |  ...  |  0  |]
+                                   |                          |
+                                [chunk] <-> [chunk]        [chunk]
+
+     NOTE: only free chunks are linked into a bin (nextFree/prevFree). every chunk, free or allocated,
+     is also linked to its physical neighbours (next/prev), that list is only used to coalesce on free()
+  */
+
+  /** [statistics, kept up to date by every malloc/free so GetStats() never walks the heap] */
+  HeapStats stats;
+  common::uint32_t freeChunksInBin[NUM_BINS];
+  common::uint32_t allocatedChunksInBin[NUM_BINS];  // live allocations per size class
+  bool largestFreeStale;  // the largest free chunk was removed, recompute on the next query
+
+  /** [serializes malloc/free/GetStats between tasks, interrupt handlers and CPUs] */
+  IrqSpinlock lock;
+
+  static common::uint32_t BinIndex(common::size_t size);
+  void InsertIntoBin(MemoryChunk* chunk);
+  void RemoveFromBin(MemoryChunk* chunk);
+  static bool Adjacent(MemoryChunk* chunk, MemoryChunk* next);
+
+  MemoryChunk* FindFreeChunk(common::size_t size);
+  void AddRegion(common::size_t start, common::size_t size);
+  bool Grow(common::size_t size);
 
  public:
   static MemoryManager* activeMemoryManager;
 
   MemoryManager(common::size_t start, common::size_t size);
+  MemoryManager(memory::PhysicalFrameAllocator* frames, common::size_t initialSize);
   ~MemoryManager();
 
   // NOTE: void* (void ptr) is a pointer to an object of an unknown size or unspecified data type
@@ -43,6 +112,11 @@ class MemoryManager {
       common::size_t size
   );  // NOTE: returns pointer to an object of *unkown* size (size is passed in as the argument)
   void free(void* ptr);
+
+  HeapStats GetStats();
+  common::uint32_t GetFreeChunksInBin(common::uint32_t bin);
+  common::uint32_t GetAllocatedChunksInBin(common::uint32_t bin);
+  LockStats GetLockStats();
 };
 
 }  // namespace os
@@ -0,0 +1,37 @@
+#ifndef __OS__MULTIBOOT_H
+#define __OS__MULTIBOOT_H
+
+#include <common/types.h>
+
+namespace os {
+
+/* NOTE: layout of the multiboot (v1) information structure handed to kernelMain by GRUB in %ebx,
+ * only the fields the kernel reads are named, see the GNU Multiboot Specification 0.6.96 */
+struct MultibootInfo {
+  common::uint32_t flags;         // which of the fields below are valid
+  common::uint32_t memLower;      // KiB of memory below 1 MiB (flags bit 0)
+  common::uint32_t memUpper;      // KiB of memory above 1 MiB, up to the first hole (flags bit 0)
+  common::uint32_t bootDevice;
+  common::uint32_t cmdline;
+  common::uint32_t modsCount;
+  common::uint32_t modsAddr;
+  common::uint32_t syms[4];
+  common::uint32_t mmapLength;  // size of the memory map buffer in bytes (flags bit 6)
+  common::uint32_t mmapAddr;    // physical address of the first MultibootMemoryMapEntry (flags bit 6)
+} __attribute__((packed));
+
+/* NOTE: entries are variable-sized, the next entry starts at (entry + entry->size + 4) */
+struct MultibootMemoryMapEntry {
+  common::uint32_t size;  // size of this entry, not counting the size field itself
+  common::uint64_t baseAddress;
+  common::uint64_t length;
+  common::uint32_t type;  // 1 := available RAM, anything else is reserved
+} __attribute__((packed));
+
+static const common::uint32_t MULTIBOOT_INFO_MEMORY = 1 << 0;
+static const common::uint32_t MULTIBOOT_INFO_MEMORY_MAP = 1 << 6;
+static const common::uint32_t MULTIBOOT_MEMORY_AVAILABLE = 1;
+
+}  // namespace os
+
+#endif
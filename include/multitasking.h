@@ -2,7 +2,9 @@
 #define __OS__MULTITASKING_H
 
 #include <common/types.h>
+#include <cpu.h>
 #include <gdt.h>
+#include <spinlock.h>
 #include <utils/print.h>
 
 namespace os {
@@ -16,6 +18,7 @@ struct CPUState {
   common::uint32_t esi;
   common::uint32_t edi;
   common::uint32_t ebp;
+  common::uint32_t interrupt;  // vector, pushed by the interrupt stub
 
   /*
   common::uint32_t gs;
@@ -33,29 +36,136 @@ struct CPUState {
   common::uint32_t ss;
 } __attribute__((packed));
 
+enum class TaskState {
+  Runnable,  // in a run queue (or running)
+  Blocked,   // waits for Wake(), e.g. an idle worker thread or a Join()
+  Sleeping,  // waits for a point in time
+  Zombie     // exited, waits for Join()
+};
+
 class Task {
   friend class TaskManager;  // allows access of member variables and functions
+  friend class FPU;
+
+ public:
+  static const common::uint32_t STACK_SIZE = 16 * 1024;
+  static const common::uint8_t NUM_PRIORITIES = 32;  // 0 := highest
+  static const common::uint8_t PRIORITY_HIGH = 8;    // interactive work, e.g. the shell worker
+  static const common::uint8_t PRIORITY_NORMAL = 16;
+  static const common::uint8_t PRIORITY_LOW = 24;  // CPU-bound background work
+  static const common::uint32_t FPU_STATE_SIZE = 512;  // FXSAVE area, FNSAVE needs 108 bytes of it
 
  private:
-  common::uint8_t stack[4096];  // NOTE: 4 KiB stack
+  common::uint8_t stack[STACK_SIZE];  // NOTE: 16 KiB stack, shell commands run on worker threads
   CPUState* cpustate;
+  volatile TaskState state;
+  bool thread;  // created by TaskManager::CreateThread(), Join() frees it
+
+  common::uint8_t priority;
+  common::uint32_t timeSlice;  // ticks left before a task of the same priority gets its turn
+  common::uint32_t runTicks;   // ticks spent running, for accounting
+  Task* next;                  // run queue link, or sleep queue link while sleeping
+  common::uint32_t wakeTick;   // tick to wake up at while sleeping
+  Task* joiner;                // task blocked in Join() on this one
+  common::uint32_t cpu;        // run queue it is on, or the CPU it last ran on
+  volatile bool running;       // a CPU is still on its stack, set until the switch away has completed
+  bool wakePending;            // woken while still running, the next Block() returns right away
+
+  common::uint8_t fpuState[FPU_STATE_SIZE + 16];  // see FPUState() for the alignment
+  bool fpuUsed;             // fpuState is valid, otherwise its first FPU instruction gets a reset FPU
+  common::uint32_t fpuCPU;  // CPU whose registers held its state last
+
+  void Init(GlobalDescriptorTable* gdt, common::uint32_t entrypoint);
+  common::uint8_t* FPUState();  // 16-byte aligned, tasks are allocated 8-byte aligned
 
  public:
   Task(GlobalDescriptorTable* gdt, void entrypoint());
+  Task(GlobalDescriptorTable* gdt, void (*entrypoint)(void*), void* argument);  // kernel thread
   ~Task();
+
+  TaskState GetState();
+  common::uint8_t GetPriority();
+  common::uint32_t GetRunTicks();
 };
 
+/**
+ * [O(1) priority scheduler with one run queue per CPU]
+ * per CPU one FIFO run queue per priority and a bitmap of the non-empty ones, picking the next task is a
+ * bsf on the bitmap. equal priorities share the CPU round-robin in TIME_SLICE tick slices, a task woken
+ * with a higher priority than the running one preempts it at the end of the waking interrupt (through a
+ * reschedule IPI if it runs on another CPU).
+ * a CPU whose run queue is empty steals the most important task of another one. a task becoming
+ * runnable goes back to the CPU it last ran on, unless that one is busy and another is idle.
+ * each CPU has an idle context (kernelMain on the bootstrap processor), it runs whenever there is
+ * nothing to run or steal.
+ */
 class TaskManager {
+ public:
+  static const common::uint32_t TIME_SLICE = 5;  // timer ticks
+  static const common::uint32_t SYSCALL_YIELD = 158;
+
  private:
+  struct RunQueue {
+    Task* head[Task::NUM_PRIORITIES];
+    Task* tail[Task::NUM_PRIORITIES];
+    common::uint32_t readyBitmap;  // bit p := head[p] != 0
+    common::uint32_t count;        // runnable tasks queued
+
+    Task* current;          // 0 := the idle context
+    Task* switchedFrom;     // its running flag is cleared once the CPU has left its stack
+    CPUState* idleState;    // NOTE: the idle context is not a Task, its state is kept while tasks run
+    volatile bool needReschedule;
+    common::uint32_t idleTicks;
+  };
+
   Task* tasks[256];
   int numTasks;  // FIXME: change from int to uint8_t (maybe ?)
-  int currentTask;
+
+  RunQueue runQueues[CPU::MAX_CPUS];
+  TicketLock lock;  // NOTE: protects the run queues, the sleep queue and the task states
+
+  Task* sleepQueue;  // sleeping tasks sorted by wakeTick, earliest first
+  volatile common::uint32_t ticks;
+  GlobalDescriptorTable* gdt;
+
+  void Lock();    // interrupts must be disabled
+  void Unlock();
+  void Enqueue(Task* task);
+  Task* Dequeue(common::uint32_t cpu);  // highest priority task, stolen if cpu has none, 0 if none
+  void Account(common::uint32_t elapsed);
+  void MakeRunnable(Task* task);
 
  public:
-  TaskManager();
+  static TaskManager* activeTaskManager;
+
+  TaskManager(GlobalDescriptorTable* gdt = 0);
   ~TaskManager();
   bool AddTask(Task* task);
-  CPUState* Schedule(CPUState* cpustate);  // NOTE: round-robin scheduling
+  CPUState* Schedule(CPUState* cpustate);
+  static void FinishSwitch();  // interrupt stub, after the switch to the new stack
+  void Tick(common::uint32_t elapsed = 1);       // kernel tick: sleepers and time-slice accounting
+  void TickLocal(common::uint32_t elapsed = 1);  // other CPUs' timers, time-slice accounting only
+  bool NeedsReschedule();
+
+  Task* CreateThread(
+      void (*entrypoint)(void*), void* argument, common::uint8_t priority = Task::PRIORITY_NORMAL
+  );  // 0 if out of memory or task slots
+  void Join(Task* task);
+  void SetPriority(Task* task, common::uint8_t priority);
+
+  static void Exit();   // ends the calling thread, also reached by returning from the entrypoint
+  static void Yield();  // gives up the rest of the time slice
+  void Block();         // the current task waits for Wake(), call with interrupts disabled
+  void Wake(Task* task);  // also ends a Sleep() early
+  void ClearPendingWake();  // drops a Wake() that reached the current task while it was not waiting
+  void Sleep(common::uint32_t duration);  // timer ticks, returns right away on a pending Wake()
+  bool CanSleep();                        // false in the idle context and in interrupt context
+  common::uint32_t GetTicks();
+  common::uint32_t GetTicksUntilWakeup();  // first sleeper, 0xFFFFFFFF := none
+
+  Task* GetCurrentTask();  // 0 := the idle context
+  common::uint32_t GetIdleTicks();  // summed over all CPUs
+  LockStats GetLockStats();
 };
 }  // namespace os
 
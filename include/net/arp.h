@@ -2,7 +2,9 @@
 #define __OS__NET_ARP_H
 
 #include <common/types.h>
+#include <multitasking.h>
 #include <net/etherframe.h>
+#include <spinlock.h>
 #include <utils/print.h>
 
 namespace os {
@@ -28,8 +30,17 @@ class AddressResolutionProtocol : public EtherFrameHandler {
   common::uint32_t IPcache[128];
   common::uint64_t MACcache[128];
   int numCacheEntries;
+  Task* resolvers[8];  // tasks sleeping in Resolve(), every reply wakes all of them
+  common::uint32_t numResolvers;
+  RWLock cacheLock;  // NOTE: protects the cache and resolvers, lookups share it, replies take it alone
+
+  common::uint64_t LookUp(common::uint32_t IP_BE);
+  bool AddResolver(Task* task);  // cacheLock held, false if the list is full
+  void RemoveResolver(Task* task);  // cacheLock held
 
  public:
+  static const common::uint32_t RESOLVE_TIMEOUT_MS = 1000;
+
   AddressResolutionProtocol(EtherFrameProvider* backend);
   ~AddressResolutionProtocol();
 
@@ -42,7 +53,8 @@ class AddressResolutionProtocol : public EtherFrameHandler {
 
   void RequestMACAddress(common::uint32_t IP_BE);
   common::uint64_t GetMACFromCache(common::uint32_t IP_BE);
-  common::uint64_t Resolve(common::uint32_t IP_BE);
+  LockStats GetLockStats();
+  common::uint64_t Resolve(common::uint32_t IP_BE, common::uint32_t timeout = RESOLVE_TIMEOUT_MS);
   void BroadcastMACAddress(common::uint32_t IP_BE);
 };
 
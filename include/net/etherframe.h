@@ -4,6 +4,7 @@
 #include <common/types.h>
 #include <drivers/amd_am79c973.h>
 #include <memorymanagement.h>
+#include <net/netbuffer.h>
 
 namespace os {
 namespace net {
@@ -34,6 +35,7 @@ class EtherFrameHandler {
 
   bool virtual OnEtherFrameReceived(common::uint8_t* etherframePayload, common::uint32_t size);
   void Send(common::uint64_t dstMAC_BE, common::uint8_t* data, common::uint32_t size);
+  void Send(common::uint64_t dstMAC_BE, NetBuffer* packet);
 };
 
 /* EtherFrameProvider: turns raw data into EthernetFrames*/
@@ -49,6 +51,8 @@ class EtherFrameProvider : public drivers::RawDataHandler {
 
   bool virtual OnRawDataReceived(common::uint8_t* buffer, common::uint32_t size);
   void Send(common::uint64_t dstMAC_BE, common::uint16_t etherType_BE, common::uint8_t* data, common::uint32_t size);
+  // NOTE: takes ownership of packet, the ethernet header is pushed into its headroom
+  void Send(common::uint64_t dstMAC_BE, common::uint16_t etherType_BE, NetBuffer* packet);
 
   common::uint64_t GetMACAddress();
   common::uint32_t GetIPAddress();
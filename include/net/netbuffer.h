@@ -0,0 +1,107 @@
+#ifndef __OS__NET__NETBUFFER_H
+#define __OS__NET__NETBUFFER_H
+
+#include <common/types.h>
+#include <spinlock.h>
+
+namespace os {
+namespace net {
+
+class NetBufferPool;
+
+/**
+ * [one packet buffer with reserved headroom, every layer prepends its header in place]
+ * the payload is written once with Put(), then each layer on the way down calls Push() for its header,
+ * so the finished frame is contiguous without any copy between layers.
+ *
+ * DIAGRAM:
+ *   storage := [| headroom ...  | data (Length() bytes) | ... tailroom |]
+ *   Push(n) grows data to the left, Put(n) grows data to the right
+ */
+class NetBuffer {
+  friend class NetBufferPool;
+  friend class NetBufferQueue;
+
+ public:
+  static const common::uint32_t CAPACITY = 2048;  // a full 1518 byte ethernet frame fits
+  static const common::uint32_t HEADROOM = 64;    // ethernet (14) + ipv4 (20) + room for one more layer
+
+ private:
+  NetBuffer* next;  // pool free list, or the queue the buffer waits in
+  NetBufferPool* pool;
+  common::uint8_t* storage;  // CAPACITY bytes
+  common::uint8_t* data;     // first byte of the packet
+  common::uint32_t length;
+
+ public:
+  NetBuffer();
+  ~NetBuffer();
+
+  void Reset();  // empty packet, HEADROOM bytes in front of it
+
+  common::uint8_t* Push(common::uint32_t size);  // prepend a header, 0 if the headroom is used up
+  common::uint8_t* Put(common::uint32_t size);   // append payload, 0 if the tailroom is used up
+  void Pull(common::uint32_t size);              // strip a header from the front
+
+  common::uint8_t* Data();
+  common::uint32_t Length();
+  common::uint32_t Headroom();
+  common::uint32_t Tailroom();
+
+  void Release();  // returns the buffer to its pool
+};
+
+
+/**
+ * [FIFO of packets, linked through the buffers themselves so Enqueue()/Dequeue() are O(1) and never allocate]
+ */
+class NetBufferQueue {
+ private:
+  NetBuffer* head;
+  NetBuffer* tail;
+  common::uint32_t count;
+
+ public:
+  NetBufferQueue();
+  ~NetBufferQueue();
+
+  void Enqueue(NetBuffer* buffer);
+  NetBuffer* Dequeue();  // 0 if empty
+  common::uint32_t Count();
+};
+
+
+/**
+ * [preallocated NetBuffers, Alloc()/Free() are O(1) and never touch the heap]
+ * the packet storage is one physically contiguous block from the buddy allocator, so the NIC can
+ * DMA directly from it
+ */
+class NetBufferPool {
+ private:
+  NetBuffer* buffers;
+  common::uint8_t* storage;
+  common::uint32_t count;
+
+  NetBuffer* freeList;
+  common::uint32_t freeCount;
+  common::uint32_t failures;  // Alloc() calls that found the pool empty
+  IrqSpinlock lock;           // NOTE: tasks allocate on any CPU, the NIC interrupt frees sent packets
+
+ public:
+  static NetBufferPool* activePool;
+
+  NetBufferPool(common::uint32_t count);
+  ~NetBufferPool();
+
+  NetBuffer* Alloc();  // reset buffer, 0 if the pool is empty
+  void Free(NetBuffer* buffer);
+
+  common::uint32_t GetCount();
+  common::uint32_t GetFreeCount();
+  common::uint32_t GetFailures();
+};
+
+}  // namespace net
+}  // namespace os
+
+#endif
@@ -0,0 +1,83 @@
+#ifndef __OS__SMP_H
+#define __OS__SMP_H
+
+#include <common/types.h>
+#include <cpu.h>
+#include <gdt.h>
+#include <hardwarecommunication/apic.h>
+#include <hardwarecommunication/interrupts.h>
+#include <multitasking.h>
+#include <utils/print.h>
+
+namespace os {
+
+/**
+ * [starts the application processors and sends them reschedule IPIs]
+ * the CPUs are listed by the ACPI MADT, or by the Intel MP table if there is no ACPI. every AP gets
+ * INIT-SIPI-SIPI and starts in real mode in the trampoline (smptrampoline.s). that enters protected
+ * mode with the bootstrap processor's paging and calls APMain(): the shared GDT and IDT, its Local APIC
+ * and timer, then an idle loop like kernelMain's. from there the TaskManager runs tasks on it.
+ * e.g.:
+ * SMP smp(&gdt, &interrupts, &localAPIC, &taskManager);
+ * smp.StartAPs();  // after interrupts.Activate()
+ * NOTE: device interrupts still go through the 8259 PIC to the bootstrap processor only, the APs get
+ * their timer and IPIs
+ */
+class SMP : public hardwarecommunication::InterruptHandler {
+ public:
+  static const common::uint8_t RESCHEDULE_INTERRUPT = 0x21;  // vector hardwareInterruptOffset + 0x21
+  static const common::uint32_t TRAMPOLINE_ADDRESS = 0x8000;  // 4 KiB aligned, below 1 MiB
+  static const common::uint32_t AP_STACK_SIZE = 16 * 1024;
+
+ private:
+  struct TrampolineParams {
+    common::uint32_t cr0;
+    common::uint32_t cr3;
+    common::uint32_t cr4;
+    common::uint32_t stack;  // top
+    common::uint32_t entry;  // void (*)()
+  } __attribute__((packed));
+
+  GlobalDescriptorTable* gdt;
+  hardwarecommunication::InterruptManager* interrupts;
+  hardwarecommunication::LocalAPIC* localAPIC;
+  TaskManager* taskManager;
+
+  common::uint8_t apicIDs[CPU::MAX_CPUS];  // index := CPU number, 0 := the bootstrap processor
+  common::uint32_t numCPUs;                // found in the tables
+  volatile common::uint32_t startingCPU;   // CPU number APMain() takes
+  volatile bool started;                   // set by APMain() once it is up
+
+  void AddCPU(common::uint8_t apicID);
+  bool FindMADT();
+  bool FindMPTable();
+  static common::uint8_t* FindSignature(
+      common::uint32_t start, common::uint32_t length, const char* signature, common::uint32_t size
+  );  // 16-byte aligned, with a zero byte checksum over size bytes
+  bool StartAP(common::uint32_t cpu);
+
+  static void APMain();
+
+ public:
+  static SMP* activeSMP;
+
+  SMP(
+      GlobalDescriptorTable* gdt,
+      hardwarecommunication::InterruptManager* interrupts,
+      hardwarecommunication::LocalAPIC* localAPIC,
+      TaskManager* taskManager
+  );
+  ~SMP();
+
+  common::uint32_t HandleInterrupt(common::uint32_t esp) override;
+
+  common::uint32_t StartAPs();                // CPUs online afterwards
+  void SendReschedule(common::uint32_t cpu);  // call with interrupts disabled
+
+  static void SyncTick();                             // before reading the kernel tick on an AP
+  static void NotifyDeadline(common::uint32_t tick);  // a sleeper or kernel timer due at tick was added
+};
+
+}  // namespace os
+
+#endif
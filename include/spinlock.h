@@ -0,0 +1,115 @@
+#ifndef __OS__SPINLOCK_H
+#define __OS__SPINLOCK_H
+
+#include <common/types.h>
+
+namespace os {
+
+/**
+ * [contention counters every lock keeps, updated by the holder so they cost no extra atomics]
+ * contentions / acquisitions is how often a lock was found taken, spins / contentions how long the
+ * waits were (in "pause" rounds)
+ */
+struct LockStats {
+  common::uint32_t acquisitions;
+  common::uint32_t contentions;  // acquisitions that had to wait
+  common::uint32_t spins;        // wait loop rounds over all contended acquisitions
+};
+
+/**
+ * [test-and-test-and-set spinlock, the raw primitive]
+ * NOTE: does not touch the interrupt flag. only for state that interrupt handlers never take, or with
+ * interrupts already disabled (e.g. the scheduler's run queues), use IrqSpinlock otherwise
+ * e.g.:
+ * lock.Lock();
+ * ...
+ * lock.Unlock();
+ */
+class Spinlock {
+ private:
+  volatile common::uint32_t locked;
+  LockStats stats;
+
+ public:
+  Spinlock();
+
+  void Lock();
+  bool TryLock();
+  void Unlock();
+  bool IsLocked();
+  LockStats GetStats();
+};
+
+/**
+ * [fair FIFO spinlock, a CPU takes a ticket and waits until it is served]
+ * unlike Spinlock, a CPU cannot lose the race again and again, so no waiter starves under contention.
+ * NOTE: like Spinlock it leaves the interrupt flag alone
+ */
+class TicketLock {
+ private:
+  volatile common::uint32_t next;     // next ticket to hand out
+  volatile common::uint32_t serving;  // ticket that holds the lock
+  LockStats stats;
+
+ public:
+  TicketLock();
+
+  void Lock();
+  bool TryLock();
+  void Unlock();
+  bool IsLocked();
+  LockStats GetStats();
+};
+
+/**
+ * [spinlock that disables interrupts on the local CPU while held]
+ * for state shared between tasks, interrupt handlers and other CPUs: a handler on the same CPU cannot
+ * spin on a lock the task it interrupted holds, since it never runs while the lock is held.
+ * e.g.:
+ * uint32_t eflags = lock.Lock();
+ * ...
+ * lock.Unlock(eflags);
+ * NOTE: nests like SaveInterrupts()/RestoreInterrupts(), release in reverse order
+ */
+class IrqSpinlock {
+ private:
+  Spinlock lock;
+
+ public:
+  IrqSpinlock();
+
+  common::uint32_t Lock();  // returns the EFLAGS to hand back to Unlock()
+  void Unlock(common::uint32_t eflags);
+  bool IsLocked();
+  LockStats GetStats();
+};
+
+/**
+ * [reader-writer spinlock, any number of readers or one writer]
+ * a waiting writer keeps new readers out, so a steady stream of readers cannot starve it. disables
+ * interrupts while held, like IrqSpinlock.
+ * e.g.:
+ * uint32_t eflags = lock.ReadLock();
+ * ...
+ * lock.ReadUnlock(eflags);
+ * NOTE: not upgradable, a reader that takes the write lock deadlocks
+ */
+class RWLock {
+ private:
+  volatile common::int32_t state;             // readers holding it, -1 := a writer holds it
+  volatile common::uint32_t writersWaiting;
+  LockStats stats;
+
+ public:
+  RWLock();
+
+  common::uint32_t ReadLock();
+  void ReadUnlock(common::uint32_t eflags);
+  common::uint32_t WriteLock();
+  void WriteUnlock(common::uint32_t eflags);
+  LockStats GetStats();
+};
+
+}  // namespace os
+
+#endif
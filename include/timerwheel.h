@@ -0,0 +1,73 @@
+#ifndef __OS__TIMERWHEEL_H
+#define __OS__TIMERWHEEL_H
+
+#include <common/types.h>
+#include <spinlock.h>
+
+namespace os {
+
+/**
+ * [one-shot kernel timer, owned by the caller and linked into the TimerWheel while pending]
+ * e.g.:
+ * Timer retransmit(&Resend, connection);
+ * ProgrammableIntervalTimer::activeTimer->AddTimer(&retransmit, 200);  // milliseconds
+ */
+struct Timer {
+  void (*function)(void*);
+  void* argument;
+  common::uint32_t expires;  // wheel tick to fire at
+  Timer* next;
+  Timer** pprev;  // the pointer that points at this timer, 0 := not pending
+
+  Timer(void (*function)(void*) = 0, void* argument = 0);
+  bool IsPending();
+};
+
+/**
+ * [hashed hierarchical timing wheel]
+ * LEVELS wheels of SLOTS lists each; level n holds the timers due within SLOTS^(n+1) ticks, hashed by
+ * the matching bits of their expiry tick. adding and cancelling are O(1), a tick only looks at one
+ * level 0 slot and, every SLOTS ticks, cascades one slot of the level above down, so thousands of
+ * pending timers cost nothing per tick.
+ * the callbacks run as deferred work (InterruptManager::Defer) with interrupts enabled, they must not
+ * sleep or block. a callback may add its timer again for a periodic timer.
+ */
+class TimerWheel {
+ public:
+  static const common::uint32_t LEVELS = 4;
+  static const common::uint32_t SLOT_BITS = 6;
+  static const common::uint32_t SLOTS = 1 << SLOT_BITS;
+  static const common::uint32_t MAX_DELAY = (1 << (LEVELS * SLOT_BITS)) - 1;  // ticks, longer is clamped
+
+ private:
+  Timer* wheel[LEVELS][SLOTS];
+  Timer* expired;  // fired timers waiting for their callback, in expiry order
+  Timer** expiredTail;
+  common::uint32_t currentTick;  // last tick processed
+  common::uint32_t pending;
+  volatile bool runScheduled;
+  IrqSpinlock lock;  // NOTE: Add() and Cancel() may run on any CPU, Tick() on the bootstrap processor
+
+  void Insert(Timer* timer);
+  void Unlink(Timer* timer);
+  void Splice(Timer** slot);
+  common::uint32_t Cascade(common::uint32_t level, common::uint32_t index);
+  static void RunExpired(void* timerWheel);
+
+ public:
+  TimerWheel();
+  ~TimerWheel();
+
+  void Add(Timer* timer, common::uint32_t delay);  // ticks, at least 1; re-adding moves a pending timer
+  bool Cancel(Timer* timer);                       // false if it was not pending
+  void Tick();                                     // timer interrupt
+
+  common::uint32_t GetTicksUntilNextTimer();  // upper bound for a tickless idle, 0xFFFFFFFF := none
+  common::uint32_t GetPending();
+  common::uint32_t GetCurrentTick();
+  LockStats GetLockStats();
+};
+
+}  // namespace os
+
+#endif
@@ -13,192 +13,214 @@ namespace utils {
 namespace ds {
 
 
-template <typename K, typename V, common::uint32_t MaxSize = 1024>
+/**
+ * [open addressing hash table, Robin Hood probing over one contiguous array of slots]
+ * every entry sits at or after its home slot (hash & mask), an insert takes the slot of an entry that is
+ * closer to its own home than the new one is ("steals from the rich"), so the probe lengths stay short
+ * and even. a lookup stops as soon as it meets an entry closer to home than the key would be.
+ * Remove() shifts the following entries back by one, there are no tombstones.
+ * the slot array is allocated on the first Insert() and doubles once it is 7/8 full.
+ * NOTE: a map with static storage duration can be declared before the heap exists, it allocates nothing
+ * until then
+ * PERFORMANCE: each slot caches the full hash, probing compares it before calling Hasher<K>::isEqual()
+ * (strcmp for C-strings), and a rehash never hashes a key again
+ */
+template <typename K, typename V>
 class HashMap {
  private:
-  struct HashNode {
+  struct Slot {
     K key;
     V value;
-    bool operator==(const HashNode& other) const {
-      return Hasher<K>::isEqual(this->key, other.key);
-    }
+    common::uint32_t hash;  // 0 := empty, see HashOf()
   };
-  /** [array of pointers to heads of LinkedList objects,
-   * where each index represents a bucket,
-   * (bucket points to head of LinkedList) ]
-   */
-  LinkedList<HashNode>* buckets[MaxSize];
 
-  common::uint32_t capacity = MaxSize;  // maximum number of buckets
-  common::uint32_t count;               // current count of elements stored
+  static const common::uint32_t INITIAL_CAPACITY = 16;  // power of two
 
- public:
-  HashMap() {
-    for (int i = 0; i < capacity; i++) {
-      buckets[i] = 0;
+  Slot* slots;                // 0 until the first Insert()
+  common::uint32_t capacity;  // number of slots, a power of two
+  common::uint32_t count;     // current count of elements stored
+
+  static common::uint32_t HashOf(const K& key) {
+    common::uint32_t hash = Hasher<K>::Hash(key);
+    return (hash != 0) ? hash : 1;
+  }
+
+  /** [how far the entry in slot index is from its home slot] */
+  common::uint32_t Distance(common::uint32_t hash, common::uint32_t index) const {
+    return (index - hash) & (capacity - 1);
+  }
+
+  /**
+   * [returns the slot index of key (whose HashOf() is hash), capacity if it is not in the map]
+   */
+  common::uint32_t Find(const K& key, common::uint32_t hash) const {
+    if (count == 0) return capacity;
+    common::uint32_t mask = capacity - 1;
+    common::uint32_t index = hash & mask;
+
+    for (common::uint32_t distance = 0;; distance++) {
+      const Slot& slot = slots[index];
+      if (slot.hash == 0 || Distance(slot.hash, index) < distance) return capacity;
+      if (slot.hash == hash && Hasher<K>::isEqual(slot.key, key)) return index;
+      index = (index + 1) & mask;
     }
-    count = 0;
   }
-  ~HashMap() {
-    for (int i = 0; i < capacity; i++) {
-      if (buckets[i] != 0) {
-        delete buckets[i];
+
+  /**
+   * [places an entry whose key is known not to be in the map yet]
+   */
+  void Place(Slot entry) {
+    common::uint32_t mask = capacity - 1;
+    common::uint32_t index = entry.hash & mask;
+
+    for (common::uint32_t distance = 0;; distance++) {
+      Slot& slot = slots[index];
+      if (slot.hash == 0) {
+        slot = entry;
+        return;
+      }
+      common::uint32_t slotDistance = Distance(slot.hash, index);
+      if (slotDistance < distance) {
+        // NOTE: the richer entry moves on in place of the new one
+        Slot displaced = slot;
+        slot = entry;
+        entry = displaced;
+        distance = slotDistance;
       }
+      index = (index + 1) & mask;
     }
   }
 
+  /**
+   * [moves every entry into a new slot array of newCapacity, returns false if out of memory]
+   */
+  bool Rehash(common::uint32_t newCapacity) {
+    // NOTE: raw bytes, operator new[] returns 0 without a heap and a Slot[] would be constructed at 0
+    Slot* newSlots = (Slot*)new common::uint8_t[newCapacity * sizeof(Slot)];
+    if (newSlots == 0) return false;
+    for (common::uint32_t i = 0; i < newCapacity; i++) {
+      new (&newSlots[i]) Slot;
+      newSlots[i].hash = 0;
+    }
+
+    Slot* oldSlots = slots;
+    common::uint32_t oldCapacity = capacity;
+    slots = newSlots;
+    capacity = newCapacity;
+    for (common::uint32_t i = 0; i < oldCapacity; i++)
+      if (oldSlots[i].hash != 0) Place(oldSlots[i]);
 
-  common::uint32_t GetBucketIndex(const K& key) {
-    // logic: Hash(key) % capacity;
-    return Hasher<K>::Hash(key) % capacity;
+    if (oldSlots != 0) delete[] (common::uint8_t*)oldSlots;
+    return true;
   }
 
+ public:
+  HashMap() {
+    slots = 0;
+    capacity = 0;
+    count = 0;
+  }
+  ~HashMap() {
+    if (slots != 0) delete[] (common::uint8_t*)slots;
+  }
 
-  void Insert(const K& key, const V& value) {
-    /* logic:
-     * get bucket index
-     * check to see if the key already exists in the bucket
-     * if so, update the value of the key in that bucket
-     * if not, create a new Node and append it to the end of the bucket and increment count
-     */
-    common::uint32_t index = GetBucketIndex(key);
-    // create a LinkedList if it doesnt exist
-    if (buckets[index] == 0) {
-      buckets[index] = (LinkedList<HashNode>*)new LinkedList<HashNode>;
-    }
+  // NOTE: owns its slot array
+  HashMap(const HashMap&) = delete;
+  HashMap& operator=(const HashMap&) = delete;
 
-    // check for collision
-    HashNode searchNode;
-    searchNode.key = key;
-    typename LinkedList<HashNode>::Node* existingNode = buckets[index]->Find(searchNode);
 
-    if (existingNode != 0) {
-      // collisionFound
-      existingNode->data.value = value;
+  /**
+   * [adds key, or replaces its value if it is already in the map]
+   * NOTE: the entry is dropped if the slot array cannot grow (no heap yet, or out of memory)
+   */
+  void Insert(const K& key, const V& value) {
+    common::uint32_t hash = HashOf(key);
+    common::uint32_t index = Find(key, hash);
+    if (index != capacity) {
+      slots[index].value = value;
       return;
     }
 
-    // at this point, collision is not found,
-    // so, append a new node with K and V
-    searchNode.value = value;
-    buckets[index]->Append(searchNode);
+    // grow at a load factor of 7/8
+    if ((count + 1) * 8 > capacity * 7) {
+      if (!Rehash((capacity == 0) ? INITIAL_CAPACITY : capacity * 2)) return;
+    }
+
+    Slot entry;
+    entry.key = key;
+    entry.value = value;
+    entry.hash = hash;
+    Place(entry);
     count++;
   }
 
 
+  /**
+   * [removes key if it is in the map, the entries after it move back one slot]
+   */
   void Remove(const K& key) {
-    common::uint32_t index = GetBucketIndex(key);
-    if (buckets[index] == 0) return;
-    HashNode dummy;
-    dummy.key = key;
-    buckets[index]->Remove(dummy);
+    common::uint32_t index = Find(key, HashOf(key));
+    if (index == capacity) return;
+
+    common::uint32_t mask = capacity - 1;
+    common::uint32_t next = (index + 1) & mask;
+    while (slots[next].hash != 0 && Distance(slots[next].hash, next) != 0) {
+      slots[index] = slots[next];
+      index = next;
+      next = (next + 1) & mask;
+    }
+    slots[index].hash = 0;
+    count--;
   }
 
   /**
    * [returns true if the key exists within the HashMap]
    */
-  bool Contains(const K& key) {
-    common::uint32_t index = GetBucketIndex(key);
-    if (buckets[index] == 0) return false;
-
-    HashNode searchNode;
-    searchNode.key = key;
-    // if Find returns a non-nullptr, then the key exists within the HashMap
-    return buckets[index]->Find(searchNode) != 0;
+  bool Contains(const K& key) const {
+    return Find(key, HashOf(key)) != capacity;
   }
 
   /**
    * [returns the total number of key-value pairs in HashMap]
    */
-  common::uint32_t GetSize() {
+  common::uint32_t GetSize() const {
     return count;
   }
 
   /**
    * [returns true if there are 0 key-value pairs in the HashMap]
    */
-  bool isEmpty() {
-    return count == 0;
-  }
-
-
   bool isEmpty() const {
     return count == 0;
   }
 
   /**
-   * [deletes all buckets and resets HashMap to empty state]
+   * [frees the slot array and resets HashMap to empty state]
    */
   void Clear() {
-    for (common::uint32_t i = 0; i < capacity; i++) {
-      if (buckets[i] != 0) {
-        delete buckets[i];  // calls LinkedList destructor, freeing all Nodes
-        buckets[i] = 0;     // reset bucket head pointer to null
-      }
-    }
-    count = 0;  // reset count
+    if (slots != 0) delete[] (common::uint8_t*)slots;
+    slots = 0;
+    capacity = 0;
+    count = 0;
   }
 
 
-  bool Get(const K& key, V& outValue) {
-    return GetImpl(key, outValue);
-  }
   bool Get(const K& key, V& outValue) const {
-    return const_cast<HashMap<K, V, MaxSize>*>(this)->GetImpl(key, outValue);
-  }
-  void GetKeys(LinkedList<K>& dest) {
-    GetKeysImpl(dest);
-  }
-  void GetKeys(LinkedList<K>& dest) const {
-    const_cast<HashMap<K, V, MaxSize>*>(this)->GetKeysImpl(dest);
-  }
-  void GetValues(LinkedList<V>& dest) {
-    GetValuesImpl(dest);
-  }
-  void GetValues(LinkedList<V>& dest) const {
-    const_cast<HashMap<K, V, MaxSize>*>(this)->GetValuesImpl(dest);
-  }
-  void GetPairs(LinkedList<Pair<K, V>>& dest) {
-    GetPairsImpl(dest);
-  }
-  void GetPairs(LinkedList<Pair<K, V>>& dest) const {
-    const_cast<HashMap<K, V, MaxSize>*>(this)->GetPairsImpl(dest);
+    common::uint32_t index = Find(key, HashOf(key));
+    if (index == capacity) return false;
+    outValue = slots[index].value;
+    return true;
   }
 
- private:
-  bool GetImpl(const K& key, V& outValue) {
-    common::uint32_t index = GetBucketIndex(key);
-    if (buckets[index] == 0) return false;
-
-    HashNode searchNode;
-    searchNode.key = key;
-
-    typename LinkedList<HashNode>::Node* existingNode = buckets[index]->Find(searchNode);
-
-    if (existingNode != 0) {
-      outValue = existingNode->data.value;
-      return true;
-    }
-    return false;
-  }
-
-
   /**
    * [populates provided LinkedList (dest) with all keys in HashMap],
    * Usage:
    * LinkedList<const char*> myKeys;
    * myMap.GetKeys(myKeys);
    */
-  void GetKeysImpl(LinkedList<K>& dest) {
-    for (common::uint32_t i = 0; i < capacity; i++) {
-      if (buckets[i] != 0) {
-        typename LinkedList<HashNode>::Node* temp = buckets[i]->head;
-        while (temp != 0) {
-          dest.Append(temp->data.key);
-          temp = temp->next;
-        }
-      }
-    }
+  void GetKeys(LinkedList<K>& dest) const {
+    for (common::uint32_t i = 0; i < capacity; i++)
+      if (slots[i].hash != 0) dest.Append(slots[i].key);
   }
 
   /**
@@ -207,30 +229,18 @@ class HashMap {
    * LinkedList<const char*> myValues;
    * myMap.GetValues(myValues);
    */
-  void GetValuesImpl(LinkedList<V>& dest) {
-    for (common::uint32_t i = 0; i < capacity; i++) {
-      if (buckets[i] != 0) {
-        typename LinkedList<HashNode>::Node* temp = buckets[i]->head;
-        while (temp != 0) {
-          dest.Append(temp->data.value);
-          temp = temp->next;
-        }
-      }
-    }
+  void GetValues(LinkedList<V>& dest) const {
+    for (common::uint32_t i = 0; i < capacity; i++)
+      if (slots[i].hash != 0) dest.Append(slots[i].value);
   }
 
-  void GetPairsImpl(LinkedList<Pair<K, V>>& dest) {
+  void GetPairs(LinkedList<Pair<K, V>>& dest) const {
     for (common::uint32_t i = 0; i < capacity; i++) {
-      if (buckets[i] != 0) {
-        typename LinkedList<HashNode>::Node* temp = buckets[i]->head;
-        while (temp != 0) {
-          Pair<K, V> pair;  // struture data from Node* temp into a KeyValuePair
-          pair.key = temp->data.key;
-          pair.value = temp->data.value;
-          dest.Append(pair);  // append the KeyValuePair containing structured data
-
-          temp = temp->next;
-        }
+      if (slots[i].hash != 0) {
+        Pair<K, V> pair;
+        pair.key = slots[i].key;
+        pair.value = slots[i].value;
+        dest.Append(pair);
       }
     }
   }
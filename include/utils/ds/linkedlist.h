@@ -2,6 +2,7 @@
 #define __OS__UTILS__DS__LINKEDLIST_H
 
 #include <common/types.h>
+#include <memory/slab.h>
 #include <memorymanagement.h>
 #include <utils/ds/pair.h>
 #include <utils/print.h>
@@ -22,26 +23,53 @@ class LinkedList {
   Node* head;
   Node* tail;
   common::uint32_t count;
+  memory::SlabCache* nodeCache;  // optional, when set Nodes come from this cache instead of the heap
 
-  LinkedList() {
+  /**
+   * [nodeCache must be created with an object size of at least sizeof(LinkedList<T>::Node)]
+   */
+  LinkedList(memory::SlabCache* nodeCache = 0) {
     head = nullptr;
     tail = nullptr;
     count = 0;
+    this->nodeCache = nodeCache;
   }
   ~LinkedList() {
     Node* temp = head;
     while (temp != nullptr) {
       Node* next = temp->next;
-      delete temp;
+      FreeNode(temp);
       temp = next;
     }
   }
 
+  /**
+   * [allocates a Node from the node cache if one is set, otherwise from the heap]
+   */
+  Node* AllocateNode() {
+    if (nodeCache == 0) return new Node;
+    void* memory = nodeCache->Alloc();
+    if (memory == 0) return 0;
+    return new (memory) Node;
+  }
+
+  /**
+   * [returns a Node to wherever AllocateNode() took it from]
+   */
+  void FreeNode(Node* node) {
+    if (nodeCache == 0) {
+      delete node;
+      return;
+    }
+    node->~Node();
+    nodeCache->Free(node);
+  }
+
   /**
    * [O(1) append to the end, making it the new tail]
    */
   void Append(T val) {
-    Node* node = new Node;
+    Node* node = AllocateNode();
     node->data = val;
     node->next = 0;
     if (head == 0) {
@@ -58,7 +86,7 @@ class LinkedList {
    * [O(1) add to the front, making it the new head]
    */
   void Prepend(T val) {
-    Node* node = new Node;
+    Node* node = AllocateNode();
     node->data = val;
     node->next = head;
     head = node;
@@ -73,7 +101,7 @@ class LinkedList {
    */
   void Insert(T val, common::uint32_t position) {
     if (position >= count) return;
-    Node* node = new Node;
+    Node* node = AllocateNode();
     node->data = val;
     Node* temp = head;
     for (int i = 1; i < position - 1 && temp != nullptr; i++) {
@@ -88,7 +116,7 @@ class LinkedList {
    * [insert a node before the first occurence of positionNode]
    */
   void Insert(T val, T positionNode) {
-    Node* node = new Node;
+    Node* node = AllocateNode();
     Node* temp = head;
     while (temp != nullptr && temp->next != positionNode) {
       temp = temp->next;
@@ -147,7 +175,7 @@ class LinkedList {
     if (head == 0) return;
     Node* temp = head;
     head = head->next;
-    delete temp;
+    FreeNode(temp);
     count--;
     if (head == 0) tail = 0;
   }
@@ -0,0 +1,64 @@
+#ifndef __OS__WORKQUEUE_H
+#define __OS__WORKQUEUE_H
+
+#include <common/types.h>
+#include <multitasking.h>
+#include <spinlock.h>
+
+namespace os {
+
+/**
+ * [jobs handed off to kernel worker threads]
+ * unlike InterruptManager::Defer(), a job runs in a task of its own, so it may wait (e.g. for an ARP
+ * reply or a disk) without holding up interrupts or the other deferred work.
+ * e.g.:
+ * WorkQueue workQueue(&taskManager, 2);
+ * WorkQueue::activeWorkQueue->Queue(&Shell::ExecuteDeferred, &shell);
+ */
+class WorkQueue {
+ public:
+  static const common::uint32_t MAX_WORK = 256;  // power of two
+  static const common::uint32_t MAX_WORKERS = 8;
+
+ private:
+  struct Work {
+    void (*function)(void*);
+    void* argument;
+  };
+
+  Work work[MAX_WORK];
+  common::uint32_t head;  // next job to run
+  common::uint32_t tail;  // next free slot
+  common::uint32_t dropped;
+
+  TaskManager* taskManager;
+  Task* workers[MAX_WORKERS];
+  common::uint32_t numWorkers;
+  Task* idle[MAX_WORKERS];  // workers waiting for a job, Queue() wakes the last one
+  common::uint32_t numIdle;
+  volatile bool stopping;
+  IrqSpinlock lock;  // NOTE: protects the queue and the idle workers, Queue() may run on any CPU
+
+  static void WorkerMain(void* queue);
+
+ public:
+  static WorkQueue* activeWorkQueue;
+
+  WorkQueue(
+      TaskManager* taskManager,
+      common::uint32_t numWorkers = 1,
+      common::uint8_t priority = Task::PRIORITY_NORMAL
+  );
+  ~WorkQueue();  // NOTE: lets the workers finish the queued jobs, then joins them
+
+  bool Queue(void (*function)(void*), void* argument);  // false if the queue is full
+
+  common::uint32_t GetPending();
+  common::uint32_t GetDropped();
+  common::uint32_t GetWorkers();
+  LockStats GetLockStats();
+};
+
+}  // namespace os
+
+#endif
@@ -23,13 +23,26 @@ bool CIU::IsReady() {
 }
 
 
+/**
+ * [routing check for officers, before they build a report]
+ * true if a report of this subsystem and severity would be printed somewhere, so Trace and Info reports
+ * (CIU terminal only, which does not exist yet) cost one route lookup and nothing else
+ * NOTE: before Init() every report is accepted, Report() prints the not ready fallback for it
+ */
+bool CIU::Accepts(const char* subsystem, CIUSeverity severity) {
+  if (!ready) return true;
+  // TODO: after CIU terminal is implemented, accept flags.toCIUTerminal too
+  return Resolve(subsystem, severity).toMainTerminal;
+}
+
+
 void CIU::Report(const CIUReport& report) {
   if (!ready) {
     printf(RED_COLOR, BLACK_COLOR, "[CIU] CIU is not ready. %s: %s\n", report.code, report.message);
     return;
   }
 
-  CIURouteFlags flags = Resolve(report);
+  CIURouteFlags flags = Resolve(report.subsystem, report.severity);
   if (flags.toMainTerminal) {
     SinkMainTerminal(report);
   }
@@ -69,14 +82,14 @@ void CIU::SetupDefaultColors() {
 }
 
 
-CIURouteFlags CIU::Resolve(const CIUReport& report) {
+CIURouteFlags CIU::Resolve(const char* subsystem, CIUSeverity severity) {
   CIURouteFlags flags;
 
-  uint32_t specificKey = MakeRouteKey(report.subsystem, report.severity);
+  uint32_t specificKey = MakeRouteKey(subsystem, severity);
   if (routingMap.Get(specificKey, flags)) {
     return flags;
   }
-  uint32_t wildcardKey = MakeRouteKey("*", report.severity);
+  uint32_t wildcardKey = MakeRouteKey("*", severity);
   if (routingMap.Get(wildcardKey, flags)) {
     return flags;
   }
@@ -149,22 +162,10 @@ void CIU::SinkMainTerminal(const CIUReport& report) {
   }
   printf("\n");
 
-  // metadata fields
-  if (!report.metadataMap.isEmpty()) {
-    ds::LinkedList<const char*> keys;
-    report.metadataMap.GetKeys(keys);
-    // printf(labelColor.fg, labelColor.bg, "{\n");
-    auto* node = keys.head;
-    while (node != 0) {
-      const char* keyName = node->data;
-      const char* value = 0;
-      if (report.metadataMap.Get(keyName, value)) {
-        printf(labelColor.fg, labelColor.bg, "{%s=", keyName);
-        printf(labelColor.fg, labelColor.bg, "%s}", value);
-        if (node->next != 0) printf(labelColor.fg, labelColor.bg, "\n");
-        node = node->next;
-      }
-    }
+  // metadata fields, in the order they were added
+  for (uint32_t i = 0; i < report.metadataCount; i++) {
+    printf(labelColor.fg, labelColor.bg, "{%s=", report.metadata[i].key);
+    printf(labelColor.fg, labelColor.bg, "%s}", report.metadata[i].value);
     printf(labelColor.fg, labelColor.bg, "\n");
   }
 }
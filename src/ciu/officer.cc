@@ -10,36 +10,54 @@ using namespace os::utils;
 CIUOfficer::CIUOfficer(const char* subsystemName) : subsystem(subsystemName) {}
 
 
+/**
+ * [returns false if a report of this severity would be dropped by the routing table]
+ * e.g.:
+ * if (officer.accepts(CIUSeverity::Trace)) {
+ *   CIUReport report(CIUSeverity::Trace, "SHELL", "", "...");
+ *   officer.send(report.meta("PHASE", "boot"));
+ * }
+ */
+bool CIUOfficer::accepts(CIUSeverity severity) {
+  return CIU::Accepts(subsystem, severity);
+}
+
+
 void CIUOfficer::send(CIUReport& report) {
   CIU::Report(report);
 }
 
 
 void CIUOfficer::trace(const char* code, const char* message) {
+  if (!accepts(CIUSeverity::Trace)) return;
   CIUReport report(CIUSeverity::Trace, subsystem, code, message);
   send(report);
 }
 
 
 void CIUOfficer::info(const char* code, const char* message) {
+  if (!accepts(CIUSeverity::Info)) return;
   CIUReport report(CIUSeverity::Info, subsystem, code, message);
   send(report);
 }
 
 
 void CIUOfficer::warning(const char* code, const char* message) {
+  if (!accepts(CIUSeverity::Warning)) return;
   CIUReport report(CIUSeverity::Warning, subsystem, code, message);
   send(report);
 }
 
 
 void CIUOfficer::error(const char* code, const char* message) {
+  if (!accepts(CIUSeverity::Error)) return;
   CIUReport report(CIUSeverity::Error, subsystem, code, message);
   send(report);
 }
 
 
 void CIUOfficer::critical(const char* code, const char* message) {
+  if (!accepts(CIUSeverity::Critical)) return;
   CIUReport report(CIUSeverity::Critical, subsystem, code, message);
   send(report);
 }
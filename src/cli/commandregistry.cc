@@ -10,6 +10,7 @@ using namespace os::net;
 using namespace os::hardwarecommunication;
 using namespace os::drivers;
 using namespace os::ciu;
+using namespace os::memory;
 
 static CIUOfficer officer("SHELL");
 
@@ -75,12 +76,14 @@ bool CommandRegistry::ValidateNetworkDependencies() {
   bool validDep = ValidateGroup(networkDeps, count);
   if (!validDep) {
     printf(BLACK_COLOR, LIGHT_RED_COLOR, "[SHELL] NETWORK COMMANDS UNAVAILABLE\n\n");
-    CIUReport report(CIUSeverity::Warning, "SHELL", "", "NETWORK COMMANDS UNAVAILABLE");
-    report.meta("PHASE", "boot")
-        .meta("CATEGORY", "init")
-        .meta("MODULE", __FILE_NAME__)
-        .meta("FUNCTION", __func__);
-    officer.send(report);
+    if (officer.accepts(CIUSeverity::Warning)) {
+      CIUReport report(CIUSeverity::Warning, "SHELL", "", "NETWORK COMMANDS UNAVAILABLE");
+      report.meta("PHASE", "boot")
+          .meta("CATEGORY", "init")
+          .meta("MODULE", __FILE_NAME__)
+          .meta("FUNCTION", __func__);
+      officer.send(report);
+    }
   }
   if (validDep) printf(BLACK_COLOR, LIGHT_CYAN_COLOR, "[SHELL] NETWORK COMMANDS AVAILABLE\n\n");
   return validDep;
@@ -140,6 +143,11 @@ bool CommandRegistry::RegisterSystemCommands() {
   shell->RegisterCommand(new whoami());
   shell->RegisterCommand(new echo());
   shell->RegisterCommand(new clear());
+  shell->RegisterCommand(new os::cli::heap(heap));  // NOTE: qualified, the local "heap" hides the class
+#ifdef HEAP_TRACE
+  shell->RegisterCommand(new heaptrace());
+  HeapTrace::SetClock(&sysTimer->ticks);
+#endif
 
   return true;
 }
@@ -6,6 +6,7 @@ using namespace os::utils;
 using namespace os::cli;
 using namespace os::drivers;
 using namespace os::hardwarecommunication;
+using namespace os::memory;
 
 whoami::whoami() : Command("whoami") {}
 void whoami::execute(char* args) {
@@ -23,3 +24,144 @@ clear::clear() : Command("clear") {}
 void clear::execute(char* args) {
   Terminal::activeTerminal->Clear();
 }
+
+
+heap::heap(MemoryManager* memoryManager) : Command("heap"), memoryManager(memoryManager) {}
+void heap::execute(char* args) {
+  bool helpFlag = false;
+  bool binsFlag = false;
+  bool slabFlag = false;
+
+  FlagOption flags[] = {
+      {"-h", "display help contents", &helpFlag},
+      {"-bins", "only display the per-size histogram", &binsFlag},
+      {"-slab", "only display the slab caches", &slabFlag}
+  };
+  int numFlags = sizeof(flags) / sizeof(flags[0]);
+
+  for (char* argv = strtok(args, " "); argv != 0; argv = strtok(0, " ")) ParseFlags(argv, flags, numFlags);
+
+  if (helpFlag) {
+    printf(LIGHT_RED_COLOR, BLACK_COLOR, "Usage: <heap> <flags>\n");
+    PrintFlags(flags, numFlags);
+    return;
+  }
+  bool all = !binsFlag && !slabFlag;
+
+  if (all) {
+    HeapStats stats = memoryManager->GetStats();
+    printf(LIGHT_CYAN_COLOR, BLACK_COLOR, "heap size:   %d KiB in %d regions\n", stats.heapSize / 1024, stats.regions);
+    printf(
+        LIGHT_CYAN_COLOR,
+        BLACK_COLOR,
+        "allocated:   %d bytes in %d chunks (peak %d bytes, %d chunks)\n",
+        stats.bytesAllocated,
+        stats.allocatedChunks,
+        stats.peakBytesAllocated,
+        stats.peakAllocatedChunks
+    );
+    printf(LIGHT_CYAN_COLOR, BLACK_COLOR, "free:        %d bytes in %d chunks\n", stats.bytesFree, stats.freeChunks);
+    printf(
+        LIGHT_CYAN_COLOR,
+        BLACK_COLOR,
+        "largest:     %d bytes, fragmentation %d%%\n",
+        stats.largestFreeBlock,
+        stats.fragmentation
+    );
+    printf(
+        LIGHT_CYAN_COLOR,
+        BLACK_COLOR,
+        "calls:       %d malloc, %d free, %d failed\n",
+        stats.allocations,
+        stats.frees,
+        stats.failures
+    );
+    LockStats lockStats = memoryManager->GetLockStats();
+    printf(
+        LIGHT_CYAN_COLOR,
+        BLACK_COLOR,
+        "lock:        %d acquired, %d contended, %d spins\n",
+        lockStats.acquisitions,
+        lockStats.contentions,
+        lockStats.spins
+    );
+  }
+
+  if (all || binsFlag) {
+    // NOTE: bin i holds chunks with size in [2^i, 2^(i+1)), empty bins are skipped
+    printf(YELLOW_COLOR, BLACK_COLOR, "size class     allocated      free\n");
+    for (uint32_t i = 0; i < MemoryManager::NUM_BINS; i++) {
+      uint32_t allocated = memoryManager->GetAllocatedChunksInBin(i);
+      uint32_t free = memoryManager->GetFreeChunksInBin(i);
+      if (allocated == 0 && free == 0) continue;
+      printf(YELLOW_COLOR, BLACK_COLOR, "2^%2d bytes    %9d %9d\n", i, allocated, free);
+    }
+  }
+
+  if (all || slabFlag) {
+    printf(LIGHT_GREEN_COLOR, BLACK_COLOR, "slab cache        size   active/total   slabs\n");
+    for (SlabCache* cache = SlabCache::First(); cache != 0; cache = cache->Next()) {
+      SlabCacheStats cacheStats = cache->GetStats();
+      printf(
+          LIGHT_GREEN_COLOR,
+          BLACK_COLOR,
+          "%s   %d   %d/%d   %d\n",
+          cache->GetName(),
+          cacheStats.objectSize,
+          cacheStats.activeObjects,
+          cacheStats.totalObjects,
+          cacheStats.slabs
+      );
+    }
+  }
+}
+
+
+#ifdef HEAP_TRACE
+heaptrace::heaptrace() : Command("heaptrace") {}
+void heaptrace::execute(char* args) {
+  bool helpFlag = false;
+  bool allFlag = false;
+
+  FlagOption flags[] = {
+      {"-h", "display help contents", &helpFlag},
+      {"-a", "display every callsite, not only the top 16", &allFlag}
+  };
+  int numFlags = sizeof(flags) / sizeof(flags[0]);
+
+  for (char* argv = strtok(args, " "); argv != 0; argv = strtok(0, " ")) ParseFlags(argv, flags, numFlags);
+
+  if (helpFlag) {
+    printf(LIGHT_RED_COLOR, BLACK_COLOR, "Usage: <heaptrace> <flags>\n");
+    PrintFlags(flags, numFlags);
+    return;
+  }
+
+  // NOTE: static, 2 KiB is an eighth of the 16 KiB task stack and the tracer must not allocate itself
+  static HeapTraceCallsite callsites[HeapTrace::MAX_CALLSITES];
+  uint32_t count = HeapTrace::GetCallsites(callsites, HeapTrace::MAX_CALLSITES);
+  if (!allFlag && count > 16) count = 16;
+
+  uint32_t now = HeapTrace::Now();
+  printf(
+      LIGHT_CYAN_COLOR,
+      BLACK_COLOR,
+      "%d live allocations traced, %d dropped (table full)\n",
+      HeapTrace::GetLiveEntries(),
+      HeapTrace::GetDropped()
+  );
+  printf(YELLOW_COLOR, BLACK_COLOR, "callsite         bytes    allocs   oldest (ticks ago)\n");
+  for (uint32_t i = 0; i < count; i++) {
+    printf(
+        YELLOW_COLOR,
+        BLACK_COLOR,
+        "0x%08x %11d %9d %9d\n",
+        callsites[i].callsite,
+        callsites[i].bytes,
+        callsites[i].allocations,
+        now - callsites[i].oldestTick
+    );
+  }
+  // NOTE: resolve callsites with "addr2line -e mykernel.bin 0x..."
+}
+#endif
@@ -10,7 +10,9 @@ using namespace os::drivers;
 using namespace os::net;
 
 
-Shell::Shell() {}
+Shell::Shell() {
+  commandPending = false;
+}
 
 
 Shell::~Shell() {}
@@ -52,6 +54,18 @@ void Shell::ExecuteCommand() {
 }
 
 
+/**
+ * [runs the typed command outside of the keyboard interrupt, on a worker thread (see WorkQueue)]
+ */
+void Shell::ExecuteDeferred(void* shell) {
+  Shell* self = (Shell*)shell;
+  self->ExecuteCommand();
+  self->bufferIndex = 0;  // reset buffer index
+  self->PrintPrompt();
+  self->commandPending = false;
+}
+
+
 void Shell::fillCommandBuffer(char fill_char, uint16_t length) {
   for (uint16_t i = 0; i < length; i++) {
     commandbuffer[i] = fill_char;
@@ -88,6 +102,8 @@ void Shell::PrintCmdFlags(char* cmd, char** flagsList) {
 
 void Shell::OnKeyDown(char c) {
   if (Terminal::activeTerminal == 0) return;
+  // NOTE: the command buffer belongs to the running command, keys typed meanwhile are dropped
+  if (commandPending) return;
   // cursor navigation
   if ((uint8_t)c == ARROW_UP) {
     Terminal::activeTerminal->moveCursor(0, -1);
@@ -143,8 +159,15 @@ void Shell::OnKeyDown(char c) {
 
     if (bufferIndex > 0) {
       commandbuffer[bufferIndex] = '\0';  // signal end of command
-      ExecuteCommand();
-      bufferIndex = 0;  // reset buffer index
+      // NOTE: a command (e.g. ping) can take long or wait for the network, it must not run inside IRQ1
+      commandPending = true;
+      WorkQueue* workQueue = WorkQueue::activeWorkQueue;
+      bool queued = (workQueue != 0) ? workQueue->Queue(&ExecuteDeferred, this)
+                                     : InterruptManager::Defer(&ExecuteDeferred, this);
+      if (queued) return;
+      commandPending = false;
+      printf(RED_COLOR, BLACK_COLOR, "[SHELL] busy, command dropped\n");
+      bufferIndex = 0;
     }
     PrintPrompt();
   }
@@ -1,11 +1,15 @@
 #include <common/types.h>
 #include <drivers/amd_am79c973.h>
+#include <memory/buddy.h>
+#include <utils/memory.h>
 
 using namespace os;
 using namespace os::common;
 using namespace os::utils;
 using namespace os::drivers;
 using namespace os::hardwarecommunication;
+using namespace os::memory;
+using namespace os::net;
 
 
 RawDataHandler::RawDataHandler(amd_am79c973* backend) {
@@ -26,8 +30,16 @@ void RawDataHandler::Send(uint8_t* buffer, uint32_t size) {
 }
 
 
+/**
+ * [sets up the card with 2^sendRingLog2 send and 2^recvRingLog2 receive descriptors]
+ * e.g.:
+ * new amd_am79c973(&dev, interrupts);        // 32 + 32 descriptors
+ * new amd_am79c973(&dev, interrupts, 9, 7);  // 512 send, 128 receive descriptors
+ * NOTE: log2 values above MAX_RING_LOG2 are clamped, every descriptor costs BUFFER_SIZE bytes of DMA memory
+ */
 amd_am79c973::amd_am79c973(
-    PeripheralComponentInterconnectDeviceDescriptor* dev, InterruptManager* interrupts
+    PeripheralComponentInterconnectDeviceDescriptor* dev, InterruptManager* interrupts,
+    uint8_t sendRingLog2, uint8_t recvRingLog2
 )
     : Driver(),
       InterruptHandler(interrupts, dev->interrupt + interrupts->HardwareInterruptOffset()),
@@ -40,8 +52,21 @@ amd_am79c973::amd_am79c973(
       busControlRegisterDataPort(dev->portBase + 0x16) {
   this->handler = 0;
 
+  if (sendRingLog2 > MAX_RING_LOG2) sendRingLog2 = MAX_RING_LOG2;
+  if (recvRingLog2 > MAX_RING_LOG2) recvRingLog2 = MAX_RING_LOG2;
+  sendRingSize = 1 << sendRingLog2;
+  recvRingSize = 1 << recvRingLog2;
+
   currentSendBuffer = 0;
   currentRecvBuffer = 0;
+  reclaimSendBuffer = 0;
+  sendInFlight = 0;
+  polling = true;
+  pollScheduled = false;
+  dmaFailed = false;
+  sendPackets = new NetBuffer*[sendRingSize];
+  for (uint32_t i = 0; i < sendRingSize; i++) sendPackets[i] = 0;
+  memset(&statistics, 0, sizeof(statistics));
 
   uint64_t MAC0 = MACAddress0Port.Read() % 256;
   uint64_t MAC1 = MACAddress0Port.Read() / 256;
@@ -65,9 +90,9 @@ amd_am79c973::amd_am79c973(
   initBlock.mode = 0x0000;  // promiscuous mode = false
   // initBlock.mode = 0x8000; // promiscuous mode = true
   initBlock.reserved1 = 0;
-  initBlock.numSendBuffers = 3;
+  initBlock.numSendBuffers = sendRingLog2;
   initBlock.reserved2 = 0;
-  initBlock.numRecvBuffers = 3;
+  initBlock.numRecvBuffers = recvRingLog2;
   initBlock.physicalAddress = MAC;
 
   /* TEST: split MAC address into multiple segments to fix compiler error, STATUS: not needed, compiler
@@ -80,21 +105,46 @@ amd_am79c973::amd_am79c973(
   initBlock.reserved3 = 0;
   initBlock.logicalAddress = 0;
 
-  sendBufferDescr = (BufferDescriptor*)((((uint32_t)&sendBufferDescrMemory[0]) + 15) & ~((uint32_t)0xF));
+  // NOTE: the buddy allocator must be constructed before any driver (see kernelMain)
+  BuddyAllocator* buddy = BuddyAllocator::activeBuddyAllocator;
+
+  // both descriptor rings share one block, the card wants them 16 byte aligned
+  uint8_t* ringMemory = 0;
+  sendBuffers = 0;
+  recvBuffers = 0;
+  if (buddy != 0) {
+    ringMemory =
+        (uint8_t*)buddy->AllocContiguous((sendRingSize + recvRingSize) * sizeof(BufferDescriptor), 16);
+    sendBuffers = (uint8_t*)buddy->AllocContiguous(sendRingSize * BUFFER_SIZE, 16);
+    recvBuffers = (uint8_t*)buddy->AllocContiguous(recvRingSize * BUFFER_SIZE, 16);
+  }
+  if (ringMemory == 0 || sendBuffers == 0 || recvBuffers == 0) {
+    printf(RED_COLOR, BLACK_COLOR, "NETWORK ERROR: AMD am79c973 OUT OF DMA MEMORY\n");
+    // NOTE: the card stays stopped (no init block), Activate(), Send() and the IRQ handler do nothing,
+    // the destructor frees whatever was allocated
+    dmaFailed = true;
+    sendBufferDescr = (BufferDescriptor*)ringMemory;
+    recvBufferDescr = 0;
+    return;
+  }
+
+  sendBufferDescr = (BufferDescriptor*)ringMemory;
   initBlock.sendBufferDescrAddress = (uint32_t)sendBufferDescr;
-  recvBufferDescr = (BufferDescriptor*)((((uint32_t)&recvBufferDescrMemory[0]) + 15) & ~((uint32_t)0xF));
+  recvBufferDescr = (BufferDescriptor*)(ringMemory + sendRingSize * sizeof(BufferDescriptor));
   initBlock.recvBufferDescrAddress = (uint32_t)recvBufferDescr;
 
-  for (uint8_t i = 0; i < 8; i++) {
-    sendBufferDescr[i].address = (((uint32_t)&sendBuffers[i]) + 15) & ~(uint32_t)0xF;
+  for (uint32_t i = 0; i < sendRingSize; i++) {
+    sendBufferDescr[i].address = (uint32_t)&sendBuffers[i * BUFFER_SIZE];
     sendBufferDescr[i].flags = 0x7FF | 0xF000;
     sendBufferDescr[i].flags2 = 0;
     sendBufferDescr[i].avail = 0;
+  }
 
-    recvBufferDescr[i].address = (((uint32_t)&recvBuffers[i]) + 15) & ~(uint32_t)0xF;
+  for (uint32_t i = 0; i < recvRingSize; i++) {
+    recvBufferDescr[i].address = (uint32_t)&recvBuffers[i * BUFFER_SIZE];
     recvBufferDescr[i].flags = 0xF7FF | 0x80000000;
     recvBufferDescr[i].flags2 = 0;
-    sendBufferDescr[i].avail = 0;
+    recvBufferDescr[i].avail = 0;
   }
 
   registerAddressPort.Write(1);
@@ -104,10 +154,23 @@ amd_am79c973::amd_am79c973(
 }
 
 
-amd_am79c973::~amd_am79c973() {}
+amd_am79c973::~amd_am79c973() {
+  for (uint32_t i = 0; i < sendRingSize; i++)
+    if (sendPackets[i] != 0) sendPackets[i]->Release();
+  delete[] sendPackets;
+  // NOTE: packets still waiting in sendQueue are released by its destructor
+
+  // NOTE: after a failed allocation some of the blocks are missing, only the ones that exist are freed
+  BuddyAllocator* buddy = BuddyAllocator::activeBuddyAllocator;
+  // also frees recvBufferDescr (same block)
+  if (sendBufferDescr != 0) buddy->FreeContiguous(sendBufferDescr);
+  if (sendBuffers != 0) buddy->FreeContiguous(sendBuffers);
+  if (recvBuffers != 0) buddy->FreeContiguous(recvBuffers);
+}
 
 
 void amd_am79c973::Activate() {
+  if (dmaFailed) return;  // NOTE: no rings, the card must never be started
   printf("AMD am79c973 Activating...\n");
 
   // 1. Enable Initialization (INIT) and Interrupts (IENA)
@@ -143,23 +206,48 @@ int amd_am79c973::Reset() {
 
 
 uint32_t amd_am79c973::HandleInterrupt(common::uint32_t esp) {
+  if (dmaFailed) return esp;
+  uint32_t eflags = lock.Lock();
   registerAddressPort.Write(0);
   uint32_t temp = registerDataPort.Read();
+  lock.Unlock(eflags);
 
   if ((temp & 0x8000) == 0x8000) printf(RED_COLOR, BLACK_COLOR, "NETWORK ERROR: AMD am79c973 ERROR\n");
   if ((temp & 0x2000) == 0x2000)
     printf(RED_COLOR, BLACK_COLOR, "NETWORK ERROR: AMD am79c973 COLLISION ERROR\n");
-  if ((temp & 0x1000) == 0x1000)
+  if ((temp & 0x1000) == 0x1000) {
+    statistics.rxMissed++;
     printf(RED_COLOR, BLACK_COLOR, "NETWORK ERROR: AMD am79c973 MISSED FRAME\n");
+  }
   if ((temp & 0x0800) == 0x0800)
     printf(RED_COLOR, BLACK_COLOR, "NETWORK ERROR: AMD am79c973 MEMORY ERROR\n");
-  if ((temp & 0x0400) == 0x0400)
-    printf(LIGHT_BLUE_COLOR, BLACK_COLOR, "NETWORK INTERRUPT: DATA RECEIVED\n");
-  Receive();
-  if ((temp & 0x0200) == 0x0200) printf(LIGHT_BLUE_COLOR, BLACK_COLOR, "NETWORK INTERRUPT: DATA SENT\n");
+  // NOTE: printing every received frame got too slow under load so commented out
+  // if ((temp & 0x0400) == 0x0400) printf(LIGHT_BLUE_COLOR, BLACK_COLOR, "NETWORK INTERRUPT: DATA RECEIVED\n");
+  if ((temp & 0x0400) == 0x0400) {
+    if (!polling) {
+      Receive(recvRingSize);
+    } else if (!pollScheduled) {
+      // NOTE: NAPI-style, no further RX interrupts until Poll() has emptied the ring
+      if (InterruptManager::Defer(&PollDeferred, this)) {
+        SetReceiveInterruptMask(true);
+        pollScheduled = true;
+      } else {
+        Receive(recvRingSize);  // deferred work queue full, fall back to draining in the IRQ
+      }
+    }
+  }
+  // NOTE: TX complete, give finished packets back to their pool and refill the ring from the queue
+  // NOTE: the lock is not held across Receive(), the handler may send a reply from there
+  eflags = lock.Lock();
+  if ((temp & 0x0200) == 0x0200) {
+    ReclaimSendBuffers();
+    FlushSendQueue();
+  }
+  // if ((temp & 0x0200) == 0x0200) printf(LIGHT_BLUE_COLOR, BLACK_COLOR, "NETWORK INTERRUPT: DATA SENT\n");
   // acknowledge
   registerAddressPort.Write(0);
   registerDataPort.Write(temp);
+  lock.Unlock(eflags);
 
   // NOTE: printing INIT DONE got annoying so commented out
   // if((temp & 0x0100) == 0x0100) printf("AMD am79c973 INIT DONE\n");
@@ -168,17 +256,93 @@ uint32_t amd_am79c973::HandleInterrupt(common::uint32_t esp) {
 }
 
 
+/**
+ * [true if the next send descriptor cannot be used yet]
+ * sendInFlight covers every descriptor the driver handed out, the OWN bit is checked as well so a
+ * descriptor the card still holds is never overwritten
+ */
+bool amd_am79c973::SendRingFull() {
+  return sendInFlight == sendRingSize || (sendBufferDescr[currentSendBuffer].flags & 0x80000000) != 0;
+}
+
+
+/**
+ * [frees every descriptor, in ring order, whose OWN bit the card has cleared]
+ */
+void amd_am79c973::ReclaimSendBuffers() {
+  while (sendInFlight > 0 && (sendBufferDescr[reclaimSendBuffer].flags & 0x80000000) == 0) {
+    if (sendPackets[reclaimSendBuffer] != 0) {
+      sendPackets[reclaimSendBuffer]->Release();
+      sendPackets[reclaimSendBuffer] = 0;
+      // the descriptor falls back to its own buffer for the copying Send()
+      sendBufferDescr[reclaimSendBuffer].address = (uint32_t)&sendBuffers[reclaimSendBuffer * BUFFER_SIZE];
+    }
+    reclaimSendBuffer = (reclaimSendBuffer + 1) & (sendRingSize - 1);
+    sendInFlight--;
+  }
+}
+
+
+/**
+ * [moves queued packets onto free descriptors, oldest first]
+ */
+void amd_am79c973::FlushSendQueue() {
+  while (sendQueue.Count() > 0 && !SendRingFull()) Transmit(sendQueue.Dequeue());
+}
+
+
+/**
+ * [hands the packet to the next send descriptor and kicks the card, the ring must not be full]
+ */
+void amd_am79c973::Transmit(NetBuffer* packet) {
+  uint32_t sendDescriptor = currentSendBuffer;
+  currentSendBuffer = (currentSendBuffer + 1) & (sendRingSize - 1);
+
+  sendPackets[sendDescriptor] = packet;
+  sendInFlight++;
+  statistics.txPackets++;
+
+  sendBufferDescr[sendDescriptor].address = (uint32_t)packet->Data();
+  sendBufferDescr[sendDescriptor].avail = 0;
+  sendBufferDescr[sendDescriptor].flags2 = 0;
+  sendBufferDescr[sendDescriptor].flags = 0x8300F000 | ((uint16_t)((-(int)packet->Length()) & 0xFFF));
+  registerAddressPort.Write(0);
+  registerDataPort.Write(0x48);
+}
+
+
+/**
+ * [copying send, for frames that live in memory the driver does not own (e.g. a receive buffer echoed back)]
+ * NOTE: if the ring is full the frame is copied into a pooled buffer and queued instead
+ */
 void amd_am79c973::Send(uint8_t* buffer, int size) {
-  int sendDescriptor = currentSendBuffer;
-  currentSendBuffer = (currentSendBuffer + 1) % 8;
+  if (dmaFailed) {
+    statistics.txDrops++;
+    return;
+  }
+  uint32_t eflags = lock.Lock();
+  ReclaimSendBuffers();
+  FlushSendQueue();
 
   if (size > 1518) size = 1518;
 
-  for (uint8_t *src = buffer + size - 1,
-               *dst = (uint8_t*)(sendBufferDescr[sendDescriptor].address + size - 1);
-       src >= buffer;
-       src--, dst--)
-    *dst = *src;
+  if (sendQueue.Count() > 0 || SendRingFull()) {
+    NetBuffer* packet = (NetBufferPool::activePool != 0) ? NetBufferPool::activePool->Alloc() : 0;
+    if (packet == 0) {
+      statistics.txRingFull++;
+      statistics.txDrops++;  // NOTE: nowhere to keep the copy, the frame is dropped
+    } else {
+      memcpy(packet->Put(size), buffer, size);
+      Enqueue(packet);
+    }
+    lock.Unlock(eflags);
+    return;
+  }
+
+  uint32_t sendDescriptor = currentSendBuffer;
+  currentSendBuffer = (currentSendBuffer + 1) & (sendRingSize - 1);
+
+  memcpy((uint8_t*)sendBufferDescr[sendDescriptor].address, buffer, size);
 
   // printf("\nSending Packet: ");
   // for (int i = 0; i < size; i++) {
@@ -187,25 +351,88 @@ void amd_am79c973::Send(uint8_t* buffer, int size) {
   // }
   // printf("| Packet END.\n");
 
+  sendInFlight++;
+  statistics.txPackets++;
   sendBufferDescr[sendDescriptor].avail = 0;
   sendBufferDescr[sendDescriptor].flags2 = 0;
   sendBufferDescr[sendDescriptor].flags = 0x8300F000 | ((uint16_t)((-size) & 0xFFF));
   registerAddressPort.Write(0);
   registerDataPort.Write(0x48);
+  lock.Unlock(eflags);
+}
+
+
+/**
+ * [zero-copy send, the descriptor points at the packet data and the card reads it via bus mastering]
+ * the packet is released by ReclaimSendBuffers() on the TX-complete interrupt (CSR0 0x0200).
+ * while the ring is full packets wait in sendQueue (up to MAX_SEND_QUEUE) and FlushSendQueue() hands them
+ * to the card in order as descriptors come back.
+ * NOTE: callable from any CPU and from the receive path, the ring and the queue are under lock
+ */
+void amd_am79c973::Send(NetBuffer* packet) {
+  if (dmaFailed) {
+    statistics.txDrops++;
+    packet->Release();
+    return;
+  }
+  uint32_t eflags = lock.Lock();
+  ReclaimSendBuffers();
+  FlushSendQueue();
+
+  if (packet->Length() > 1518) {
+    statistics.txDrops++;
+    packet->Release();  // NOTE: oversized frame, dropped
+  } else {
+    Enqueue(packet);
+  }
+  lock.Unlock(eflags);
+}
+
+
+/**
+ * [transmits the packet right away if nothing is waiting and the ring has room, queues it otherwise]
+ */
+void amd_am79c973::Enqueue(NetBuffer* packet) {
+  if (sendQueue.Count() == 0 && !SendRingFull()) {
+    Transmit(packet);
+    return;
+  }
+
+  statistics.txRingFull++;
+  if (sendQueue.Count() >= MAX_SEND_QUEUE) {
+    statistics.txDrops++;
+    packet->Release();  // NOTE: the card cannot keep up, dropped
+    return;
+  }
+
+  sendQueue.Enqueue(packet);
+  statistics.txQueued++;
 }
 
 
-void amd_am79c973::Receive() {
-  for (; (recvBufferDescr[currentRecvBuffer].flags & 0x80000000) == 0;
-       currentRecvBuffer = (currentRecvBuffer + 1) % 8) {
-    if (!(recvBufferDescr[currentRecvBuffer].flags & 0x40000000) &&
-        (recvBufferDescr[currentRecvBuffer].flags & 0x03000000) == 0x03000000) {
-      uint32_t size = recvBufferDescr[currentRecvBuffer].flags & 0xFFF;
+/**
+ * [hands up to budget received frames to the handler, stops early once the card owns the next descriptor]
+ * interrupts are disabled only while a descriptor is read and while it is handed back to the card,
+ * the handler (and the reply it may send) runs with interrupts in the caller's state, so from Poll()
+ * the timer and keyboard still get through while a frame is processed
+ */
+uint32_t amd_am79c973::Receive(uint32_t budget) {
+  uint32_t handled = 0;
+  for (; handled < budget && (recvBufferDescr[currentRecvBuffer].flags & 0x80000000) == 0;
+       currentRecvBuffer = (currentRecvBuffer + 1) & (recvRingSize - 1)) {
+    uint32_t eflags = SaveInterrupts();
+    uint32_t flags = recvBufferDescr[currentRecvBuffer].flags;
+    uint8_t* buffer = (uint8_t*)(recvBufferDescr[currentRecvBuffer].address);
+    RestoreInterrupts(eflags);
+
+    if (flags & 0x40000000) statistics.rxErrors++;
+
+    if (!(flags & 0x40000000) && (flags & 0x03000000) == 0x03000000) {
+      statistics.rxPackets++;
+      uint32_t size = flags & 0xFFF;
       if (size > 64)  // remove checksum
         size -= 4;
 
-      uint8_t* buffer = (uint8_t*)(recvBufferDescr[currentRecvBuffer].address);
-
 
       if (handler != 0) {
         if (handler->OnRawDataReceived(buffer, size)) {
@@ -226,11 +453,93 @@ void amd_am79c973::Receive() {
     }
 
 
+    // NOTE: the card owns the buffer again once flags is written, nothing reads it after this
+    eflags = SaveInterrupts();
     recvBufferDescr[currentRecvBuffer].flags2 = 0;
     recvBufferDescr[currentRecvBuffer].flags = 0x8000F7FF;
+    RestoreInterrupts(eflags);
+    handled++;
+  }
+  return handled;
+}
+
+
+/**
+ * [masks (true) or unmasks (false) the receive interrupt, CSR3 bit 10 (RINTM)]
+ */
+void amd_am79c973::SetReceiveInterruptMask(bool masked) {
+  uint32_t eflags = lock.Lock();
+
+  registerAddressPort.Write(3);
+  uint32_t csr3 = registerDataPort.Read();
+  registerAddressPort.Write(3);
+  registerDataPort.Write(masked ? (csr3 | (1 << 10)) : (csr3 & ~(1 << 10)));
+
+  lock.Unlock(eflags);
+}
+
+
+/**
+ * [bottom half of the receive path, called with interrupts enabled (see PollDeferred())]
+ * drains up to budget descriptors. once the ring is empty the receive interrupt is unmasked again, so
+ * under a flood the card is serviced at the pace of the poll loop instead of livelocking the CPU in IRQs.
+ */
+bool amd_am79c973::Poll(uint32_t budget) {
+  if (dmaFailed || !pollScheduled) return false;
+
+  statistics.rxPolls++;
+  if (Receive(budget) == budget) return true;
+
+  uint32_t eflags = SaveInterrupts();
+  // NOTE: a frame that landed after Receive() returned may have had its RINT acknowledged by a TX
+  // interrupt, so look again before going back to interrupt mode
+  if ((recvBufferDescr[currentRecvBuffer].flags & 0x80000000) == 0) {
+    RestoreInterrupts(eflags);
+    return true;
   }
+  pollScheduled = false;
+  SetReceiveInterruptMask(false);
+  RestoreInterrupts(eflags);
+  return false;
+}
+
+
+/**
+ * [deferred work item, polls one budget and queues itself again while the ring has more, so other deferred
+ * work gets its turn between passes]
+ */
+void amd_am79c973::PollDeferred(void* driver) {
+  amd_am79c973* nic = (amd_am79c973*)driver;
+  if (!nic->Poll(POLL_BUDGET)) return;
+  if (InterruptManager::Defer(&PollDeferred, nic)) return;
+
+  // NOTE: queue full, back to interrupt mode, the next RX interrupt schedules the poll again
+  uint32_t eflags = SaveInterrupts();
+  nic->pollScheduled = false;
+  nic->SetReceiveInterruptMask(false);
+  RestoreInterrupts(eflags);
+}
+
+
+bool amd_am79c973::PollPending() {
+  return pollScheduled;
+}
+
+
+/**
+ * [true := hybrid interrupt/polling receive (default), false := the whole ring is drained inside the IRQ]
+ */
+void amd_am79c973::SetPolling(bool polling) {
+  this->polling = polling;
 }
 
+
+
+amd_am79c973::Statistics* amd_am79c973::GetStatistics() {
+  return &statistics;
+}
+
+
 void amd_am79c973::SetHandler(RawDataHandler* handler) {
   this->handler = handler;
 }
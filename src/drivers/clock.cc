@@ -0,0 +1,132 @@
+#include <drivers/clock.h>
+
+using namespace os;
+using namespace os::common;
+using namespace os::drivers;
+using namespace os::hardwarecommunication;
+using namespace os::utils;
+
+Clock* Clock::activeClock = 0;
+
+
+/**
+ * [64 by 32 bit division with divl, the quotient must fit in 32 bits]
+ * NOTE: the kernel is not linked against libgcc, a plain 64-bit "/" would need __udivdi3
+ */
+static inline uint32_t Divide(uint64_t dividend, uint32_t divisor) {
+  uint32_t quotient, remainder;
+  asm("divl %4"
+      : "=a"(quotient), "=d"(remainder)
+      : "a"((uint32_t)dividend), "d"((uint32_t)(dividend >> 32)), "rm"(divisor));
+  return quotient;
+}
+
+
+Clock::Clock(ProgrammableIntervalTimer* pit)
+    : pitChannel2Port(0x42),
+      pitCommandPort(0x43),
+      speakerPort(0x61) {
+  activeClock = this;
+  this->pit = pit;
+  nsPerTick = 1000000000 / pit->GetFrequency();
+  tsc = false;
+  tscKHz = 0;
+  mult = 0;
+
+  uint32_t eax, ebx, ecx, edx;
+  asm volatile("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(1));
+  if (!(edx & (1 << 4))) {
+    printf(LIGHT_GRAY_COLOR, BLACK_COLOR, "[CLOCK] no TSC, using the PIT ticks\n");
+    return;
+  }
+
+  // NOTE: the shortest of a few runs, a longer one was stretched by an SMI or a preempted vCPU
+  uint64_t cycles = 0;
+  for (int i = 0; i < 3; i++) {
+    uint64_t run = CalibrateCycles();
+    if (run != 0 && (cycles == 0 || run < cycles)) cycles = run;
+  }
+
+  // NOTE: below 1 MHz the ns per cycle would not fit in mult
+  if ((cycles >> 32) >= CALIBRATION_MS || cycles < 1000 * CALIBRATION_MS) {
+    printf(LIGHT_GRAY_COLOR, BLACK_COLOR, "[CLOCK] TSC calibration failed, using the PIT ticks\n");
+    return;
+  }
+
+  tscKHz = Divide(cycles, CALIBRATION_MS);
+  mult = Divide((uint64_t)1000000 << SHIFT, tscKHz);
+  baseCycles = ReadTSC();
+  tsc = true;
+
+  printf(LIGHT_GRAY_COLOR, BLACK_COLOR, "[CLOCK] TSC calibrated at %d kHz\n", tscKHz);
+}
+
+
+Clock::~Clock() {
+  if (activeClock == this) activeClock = 0;
+}
+
+
+/**
+ * [counts TSC cycles while PIT channel 2 counts down CALIBRATION_MS in mode 0]
+ * the channel's output (port 0x61 bit 5) goes high at the terminal count
+ */
+uint64_t Clock::CalibrateCycles() {
+  uint32_t latch = 1193182 * CALIBRATION_MS / 1000;
+
+  uint8_t speaker = speakerPort.Read();
+  speakerPort.Write((speaker & ~0x02) | 0x01);  // gate on, speaker off
+
+  pitCommandPort.Write(0xB0);  // channel 2, low byte then high byte, mode 0
+  pitChannel2Port.Write(latch & 0xFF);
+  pitChannel2Port.Write((latch >> 8) & 0xFF);
+
+  uint64_t start = ReadTSC();
+  uint64_t end = start;
+  uint32_t loops = 0;
+  while (!(speakerPort.Read() & 0x20) && loops < 100000000) {
+    end = ReadTSC();
+    loops++;
+  }
+
+  speakerPort.Write(speaker);
+
+  // NOTE: too few reads means the output was already high, too many that it never went high
+  if (loops < 1000 || loops >= 100000000) return 0;
+  return end - start;
+}
+
+
+/**
+ * [nanoseconds since the calibration, or since boot in ticks without a TSC]
+ */
+uint64_t Clock::GetNanoseconds() {
+  if (!tsc) return pit->ticks * nsPerTick;
+  return CyclesToNanoseconds(ReadTSC() - baseCycles);
+}
+
+
+/**
+ * [(cycles * mult) >> SHIFT without a 96-bit product: both 32-bit halves are scaled separately]
+ */
+uint64_t Clock::CyclesToNanoseconds(uint64_t cycles) {
+  uint64_t high = (uint64_t)(uint32_t)(cycles >> 32) * mult;
+  uint64_t low = (uint64_t)(uint32_t)cycles * mult;
+  return (high << (32 - SHIFT)) + (low >> SHIFT);
+}
+
+
+void Clock::Delay(uint32_t nanoseconds) {
+  uint64_t end = GetNanoseconds() + nanoseconds;
+  while (GetNanoseconds() < end) asm volatile("pause");
+}
+
+
+bool Clock::HasTSC() {
+  return tsc;
+}
+
+
+uint32_t Clock::GetTSCFrequencyKHz() {
+  return tscKHz;
+}
@@ -73,12 +73,15 @@ void Terminal::Render() {
 
 void Terminal::PutChar(char c, VGAColor fg, VGAColor bg) {
   uint8_t color = (uint8_t)fg | ((uint8_t)bg << 4);
+  uint32_t eflags = lock.Lock();
 
   if (c == '\n') {  // new line
     cursorY++;
     cursorX = 0;
   } else if (c == '\b') {  // backspace
-    Backspace();
+    EraseLast();
+    SnapToBottom();
+    lock.Unlock(eflags);
     return;
   } else if (c == '\t') {  // tabs are 4 space
     cursorX += 4;
@@ -108,12 +111,21 @@ void Terminal::PutChar(char c, VGAColor fg, VGAColor bg) {
     }
     cursorY = HISTORY_SIZE - 1;
   }
-  ScrollToBottom();  // snap to bottom so you are always typing on the bottom line
+  SnapToBottom();  // snap to bottom so you are always typing on the bottom line
   Render();
+  lock.Unlock(eflags);
 }
 
 
 void Terminal::Backspace() {
+  uint32_t eflags = lock.Lock();
+  EraseLast();
+  SnapToBottom();
+  lock.Unlock(eflags);
+}
+
+
+void Terminal::EraseLast() {
   if (cursorX > 0) {
     cursorX--;
   } else if (cursorX <= 0 && cursorY > 0) {
@@ -121,29 +133,39 @@ void Terminal::Backspace() {
     cursorY--;
   }
   buffer[cursorY][cursorX] = 0x0700 | ' ';  // overwrite with blank space
-  ScrollToBottom();
 }
 
 
 void Terminal::ScrollUp() {
+  uint32_t eflags = lock.Lock();
   if (viewOffset > 0) {
     viewOffset--;
     Render();
   }
+  lock.Unlock(eflags);
 }
 
 
 void Terminal::ScrollDown() {
+  uint32_t eflags = lock.Lock();
   // check to make sure you don't scroll past bottom of buffer contents
   if (viewOffset + VGA_HEIGHT < cursorY + 1) {
     // allow scrolling up to last line of buffer contents
     viewOffset++;
     Render();
   }
+  lock.Unlock(eflags);
 }
 
 
 void Terminal::ScrollToBottom() {
+  uint32_t eflags = lock.Lock();
+  SnapToBottom();
+  lock.Unlock(eflags);
+}
+
+
+void Terminal::SnapToBottom() {
   if (cursorY < VGA_HEIGHT) {
     viewOffset = 0;
   } else {
@@ -178,6 +200,7 @@ void Terminal::showScrollingStatus(uint16_t* vgaMemory) {
 
 
 void Terminal::moveCursor(int8_t dx, int8_t dy) {
+  uint32_t eflags = lock.Lock();
   int newX = cursorX + dx;
   int newY = cursorY + dy;
   if (newX < 0) newX = 0;
@@ -189,10 +212,12 @@ void Terminal::moveCursor(int8_t dx, int8_t dy) {
   cursorY = newY;
 
   Render();
+  lock.Unlock(eflags);
 }
 
 
 void Terminal::Clear() {
+  uint32_t eflags = lock.Lock();
   uint16_t blank = 0x0700 | ' ';
   for (int y = 0; y < HISTORY_SIZE; y++) {
     for (int x = 0; x < VGA_WIDTH; x++) {
@@ -203,4 +228,5 @@ void Terminal::Clear() {
   cursorY = 0;
   viewOffset = 0;
   Render();
+  lock.Unlock(eflags);
 }
@@ -1,4 +1,6 @@
 #include <drivers/timer.h>
+#include <multitasking.h>
+#include <smp.h>
 
 using namespace os;
 using namespace os::common;
@@ -6,11 +8,15 @@ using namespace os::drivers;
 using namespace os::hardwarecommunication;
 using namespace os::utils;
 
+ProgrammableIntervalTimer* ProgrammableIntervalTimer::activeTimer = 0;
+
 ProgrammableIntervalTimer::ProgrammableIntervalTimer(InterruptManager* interrupts, uint32_t frequency)
     : InterruptHandler(interrupts, interrupts->HardwareInterruptOffset() + 0),
       dataPort(0x40),
       commandPort(0x43) {
+  activeTimer = this;
   ticks = 0;  // initalize ticks to be 0 at boot
+  this->frequency = frequency;
   uint32_t internalOscillator = 1193182;
   uint32_t divisor = internalOscillator / frequency;
 
@@ -27,16 +33,94 @@ ProgrammableIntervalTimer::ProgrammableIntervalTimer(InterruptManager* interrupt
 }
 
 uint32_t ProgrammableIntervalTimer::HandleInterrupt(uint32_t esp) {
-  ticks++;
+  Tick(1);
   return esp;
 }
 
+
+/**
+ * [advances the kernel tick by elapsed ticks: the tick counter, the timer wheel and the scheduler]
+ * NOTE: elapsed > 1 after a tickless idle period (see LocalAPIC::EnterIdle)
+ */
+void ProgrammableIntervalTimer::Tick(uint32_t elapsed) {
+  ticks += elapsed;
+  for (uint32_t i = 0; i < elapsed; i++) timerWheel.Tick();  // NOTE: only moves the due timers
+
+  TaskManager* taskManager = TaskManager::activeTaskManager;
+  if (taskManager != 0) taskManager->Tick(elapsed);
+}
+
+
+uint32_t ProgrammableIntervalTimer::GetTicksUntilNextEvent() {
+  uint32_t ticks = timerWheel.GetTicksUntilNextTimer();
+  TaskManager* taskManager = TaskManager::activeTaskManager;
+  if (taskManager != 0 && taskManager->GetTicksUntilWakeup() < ticks)
+    ticks = taskManager->GetTicksUntilWakeup();
+  return ticks;
+}
+
+/**
+ * [blocks the calling task on the sleep queue instead of busy waiting]
+ * NOTE: in interrupt context and in kernelMain it halts until the tick instead (see TaskManager::Sleep)
+ */
 void ProgrammableIntervalTimer::Wait(uint32_t milliseconds) {
-  uint32_t ticksToWait = milliseconds;
-  uint64_t endTicks = ticks + ticksToWait;
+  Sleep(milliseconds);
+}
+
+
+void ProgrammableIntervalTimer::Sleep(uint32_t milliseconds) {
+  TaskManager* taskManager = TaskManager::activeTaskManager;
+  uint32_t ticksToWait = MillisecondsToTicks(milliseconds);
 
-  // [busy wait]
-  while (ticks < endTicks) {
-    asm volatile("nop");
+  if (taskManager != 0) {
+    taskManager->Sleep(ticksToWait);
+    return;
   }
+
+  // NOTE: no scheduler, halt until the ticks. they only advance with interrupts enabled, with them
+  // disabled there is no waiting (same guard as TaskManager::Sleep)
+  uint32_t eflags = SaveInterrupts();
+  uint64_t endTicks = ticks + ticksToWait;
+  while ((eflags & 0x200) && ticks < endTicks) asm volatile("sti; hlt; cli" : : : "memory");
+  RestoreInterrupts(eflags);
+}
+
+
+/**
+ * [milliseconds in ticks, rounded up, at most 0x7FFFFFFF (the longest wrap-safe tick distance)]
+ * NOTE: whole seconds and the rest separately, milliseconds * frequency would overflow 32 bits (about
+ * 12 hours at 100 Hz) and a 64-bit division needs libgcc
+ */
+uint32_t ProgrammableIntervalTimer::MillisecondsToTicks(uint32_t milliseconds) {
+  uint64_t result = (uint64_t)(milliseconds / 1000) * frequency;
+  result += ((milliseconds % 1000) * frequency + 999) / 1000;
+  return (result > 0x7FFFFFFF) ? 0x7FFFFFFF : (uint32_t)result;
+}
+
+
+uint32_t ProgrammableIntervalTimer::GetFrequency() {
+  return frequency;
+}
+
+
+/**
+ * [starts a one-shot timer, its callback runs once milliseconds have passed (rounded up to ticks)]
+ */
+void ProgrammableIntervalTimer::AddTimer(Timer* timer, uint32_t milliseconds) {
+  uint32_t delay = MillisecondsToTicks(milliseconds);
+  SMP::SyncTick();  // NOTE: on an AP, the wheel may be behind while CPU 0 idles
+  timerWheel.Add(timer, delay);
+
+  TaskManager* taskManager = TaskManager::activeTaskManager;
+  if (taskManager != 0) SMP::NotifyDeadline(taskManager->GetTicks() + (delay != 0 ? delay : 1));
+}
+
+
+bool ProgrammableIntervalTimer::CancelTimer(Timer* timer) {
+  return timerWheel.Cancel(timer);
+}
+
+
+TimerWheel* ProgrammableIntervalTimer::GetTimerWheel() {
+  return &timerWheel;
 }
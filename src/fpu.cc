@@ -0,0 +1,200 @@
+#include <fpu.h>
+
+using namespace os;
+using namespace os::common;
+using namespace os::hardwarecommunication;
+
+
+FPU::PerCPU FPU::perCPU[CPU::MAX_CPUS];
+bool FPU::hasFXSR = false;
+bool FPU::hasSSE = false;
+FPU* FPU::activeFPU = 0;
+
+
+static inline void SetTaskSwitched() {
+  uint32_t cr0;
+  asm volatile("mov %%cr0, %0" : "=r"(cr0));
+  asm volatile("mov %0, %%cr0" : : "r"(cr0 | (1 << 3)));
+}
+
+
+/**
+ * [exception 0x07 (#NM, device not available), enables the FPU on the bootstrap processor]
+ */
+FPU::FPU(InterruptManager* interruptManager) : InterruptHandler(interruptManager, 0x07) {
+  for (uint32_t cpu = 0; cpu < CPU::MAX_CPUS; cpu++) {
+    perCPU[cpu].owner = 0;
+    perCPU[cpu].enabled = false;
+    perCPU[cpu].borrowed = false;
+  }
+  InitCPU();
+  activeFPU = this;
+}
+
+
+FPU::~FPU() {
+  if (activeFPU == this) activeFPU = 0;
+}
+
+
+/**
+ * [CR0: native x87 errors (NE), WAIT honours TS (MP), no emulation (EM); CR4: FXSAVE and SSE (OSFXSR),
+ * SIMD exceptions (OSXMMEXCPT)]
+ * leaves TS set, the first FPU instruction traps and gets a clean state
+ */
+void FPU::InitCPU() {
+  uint32_t eax, ebx, ecx, edx;
+  asm volatile("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(1));
+  if (!(edx & 1)) return;  // no x87, CR0.EM stays as it is
+  hasFXSR = edx & (1 << 24);
+  hasSSE = hasFXSR && (edx & (1 << 25));
+
+  uint32_t cr0;
+  asm volatile("mov %%cr0, %0" : "=r"(cr0));
+  cr0 &= ~((1 << 2) | (1 << 3));  // EM, TS
+  cr0 |= (1 << 1) | (1 << 5);     // MP, NE
+  asm volatile("mov %0, %%cr0" : : "r"(cr0));
+
+  uint32_t cr4;
+  asm volatile("mov %%cr4, %0" : "=r"(cr4));
+  if (hasFXSR) cr4 |= (1 << 9);
+  if (hasSSE) cr4 |= (1 << 10);
+  asm volatile("mov %0, %%cr4" : : "r"(cr4));
+
+  asm volatile("fninit");
+  SetTaskSwitched();
+}
+
+
+bool FPU::HasSSE() {
+  return hasSSE;
+}
+
+
+void FPU::Save(Task* task) {
+  uint8_t* state = task->FPUState();
+  if (hasFXSR)
+    asm volatile("fxsave (%0)" : : "r"(state) : "memory");
+  else
+    asm volatile("fnsave (%0); frstor (%0)" : : "r"(state) : "memory");  // NOTE: fnsave resets the x87
+}
+
+
+void FPU::Restore(Task* task) {
+  uint8_t* state = task->FPUState();
+  if (hasFXSR)
+    asm volatile("fxrstor (%0)" : : "r"(state) : "memory");
+  else
+    asm volatile("frstor (%0)" : : "r"(state) : "memory");
+}
+
+
+void FPU::Reset() {
+  uint32_t mxcsr = 0x1F80;  // every SIMD exception masked, round to nearest
+  asm volatile("fninit");
+  if (hasSSE) asm volatile("ldmxcsr %0" : : "m"(mxcsr));
+}
+
+
+/**
+ * [#NM: the running code used the FPU with CR0.TS set]
+ * a task gets its own state back, code outside of a task (an interrupt handler, deferred work, the idle
+ * context) borrows a clean FPU until the interrupt is done
+ * NOTE: with TS set every register content has been saved already, see SwitchFrom()
+ */
+uint32_t FPU::HandleInterrupt(uint32_t esp) {
+  uint32_t cpu = CPU::Current();
+  PerCPU* local = &perCPU[cpu];
+  TaskManager* taskManager = TaskManager::activeTaskManager;
+  Task* current = (taskManager != 0) ? taskManager->GetCurrentTask() : 0;
+
+  asm volatile("clts");
+  local->enabled = true;
+
+  // NOTE: depth 1 is this exception itself
+  if (current == 0 || InterruptManager::InterruptDepth() > 1) {
+    local->owner = 0;
+    local->borrowed = true;
+    Reset();
+    return esp;
+  }
+
+  // PERFORMANCE: nothing else used the FPU on this CPU since the task last ran here, no restore
+  if (local->owner == current && current->fpuCPU == cpu) return esp;
+
+  if (current->fpuUsed) {
+    Restore(current);
+  } else {
+    Reset();
+    current->fpuUsed = true;
+  }
+  local->owner = current;
+  current->fpuCPU = cpu;
+  return esp;
+}
+
+
+/**
+ * [the scheduler switches away from previous (0 := the idle context) on the calling CPU]
+ * saves its state if it used the FPU in this run and sets TS for whatever runs next
+ * NOTE: before the switch has completed, so no other CPU can pick previous up yet (Task::running)
+ */
+void FPU::SwitchFrom(Task* previous) {
+  PerCPU* local = &perCPU[CPU::Current()];
+  if (!local->enabled) return;
+
+  if (previous != 0 && local->owner == previous) Save(previous);
+  SetTaskSwitched();
+  local->enabled = false;
+  local->borrowed = false;
+}
+
+
+/**
+ * [the calling CPU leaves its outermost interrupt, an FPU borrowed by a handler goes back to the task]
+ */
+void FPU::LeaveInterrupt() {
+  PerCPU* local = &perCPU[CPU::Current()];
+  if (!local->borrowed) return;
+
+  SetTaskSwitched();
+  local->enabled = false;
+  local->borrowed = false;
+}
+
+
+void FPU::Forget(Task* task) {
+  uint32_t eflags = SaveInterrupts();
+  for (uint32_t cpu = 0; cpu < CPU::MAX_CPUS; cpu++)
+    if (perCPU[cpu].owner == task) perCPU[cpu].owner = 0;
+  RestoreInterrupts(eflags);
+}
+
+
+/**
+ * [lets kernel code use x87/SSE registers until End(), anywhere, with interrupts disabled meanwhile]
+ * the running task's live state is saved first, it is restored on its next FPU instruction
+ * PERFORMANCE: a save only if the task used the FPU in this run, plus two CR0 writes
+ */
+uint32_t FPU::Begin() {
+  uint32_t eflags = SaveInterrupts();
+  if (activeFPU == 0) return eflags;
+  PerCPU* local = &perCPU[CPU::Current()];
+
+  if (local->enabled && local->owner != 0) Save(local->owner);
+  local->owner = 0;
+  asm volatile("clts");
+  local->enabled = true;
+  return eflags;
+}
+
+
+void FPU::End(uint32_t eflags) {
+  if (activeFPU != 0) {
+    PerCPU* local = &perCPU[CPU::Current()];
+    SetTaskSwitched();
+    local->enabled = false;
+    local->borrowed = false;
+  }
+  RestoreInterrupts(eflags);
+}
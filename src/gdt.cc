@@ -8,17 +8,25 @@ using namespace os::common;
 GlobalDescriptorTable::GlobalDescriptorTable()
     : nullSegmentSelector(0, 0, 0),
       unusedSegmentSelector(0, 0, 0),
-      codeSegmentSelector(0, 64 * 1024 * 1024, 0x9A),
-      dataSegmentSelector(0, 64 * 1024 * 1024, 0x92) {
+      codeSegmentSelector(0, 0xFFFFFFFF, 0x9A),  // NOTE: flat 4 GiB segments, protection is done by paging
+      dataSegmentSelector(0, 0xFFFFFFFF, 0x92) {
+  Load();
+}
+
+GlobalDescriptorTable::~GlobalDescriptorTable() {
+}
+
+/**
+ * [loads the table into GDTR, the constructor does it for the bootstrap processor]
+ * NOTE: the segment registers are not reloaded, the selectors match the ones the loader already uses
+ */
+void GlobalDescriptorTable::Load() {
   uint32_t i[2];
   i[1] = (uint32_t)this;
   i[0] = sizeof(GlobalDescriptorTable) << 16;
   asm volatile("lgdt (%0)" : : "p"(((uint8_t*)i) + 2));
 }
 
-GlobalDescriptorTable::~GlobalDescriptorTable() {
-}
-
 uint16_t GlobalDescriptorTable::DataSegmentSelector() {
   return (uint8_t*)&dataSegmentSelector - (uint8_t*)this;
 }
@@ -0,0 +1,271 @@
+#include <drivers/clock.h>
+#include <drivers/timer.h>
+#include <hardwarecommunication/apic.h>
+#include <memory/paging.h>
+#include <multitasking.h>
+
+using namespace os;
+using namespace os::common;
+using namespace os::drivers;
+using namespace os::memory;
+using namespace os::utils;
+using namespace os::hardwarecommunication;
+
+LocalAPIC* LocalAPIC::activeLocalAPIC = 0;
+
+
+/**
+ * [detects and enables the Local APIC, its timer stays off until StartTimer()]
+ */
+LocalAPIC::LocalAPIC(InterruptManager* interrupts)
+    : InterruptHandler(interrupts, interrupts->HardwareInterruptOffset() + TIMER_INTERRUPT) {
+  this->interrupts = interrupts;
+  registers = 0;
+  pit = 0;
+  countPerTick = 0;
+  idleUntil = 0;
+  for (uint32_t cpu = 0; cpu < CPU::MAX_CPUS; cpu++) {
+    armedTicks[cpu] = 0;
+    idle[cpu] = false;
+  }
+
+  uint32_t eax, ebx, ecx, edx;
+  asm volatile("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(1));
+  if (!(edx & (1 << 9))) {
+    printf(LIGHT_GRAY_COLOR, BLACK_COLOR, "[APIC] no Local APIC\n");
+    return;
+  }
+
+  // IA32_APIC_BASE: bits 12-31 := physical base, bit 11 := global enable
+  uint32_t low, high;
+  asm volatile("rdmsr" : "=a"(low), "=d"(high) : "c"(0x1B));
+  low |= 1 << 11;
+  asm volatile("wrmsr" : : "a"(low), "d"(high), "c"(0x1B));
+
+  uint32_t base = low & 0xFFFFF000;
+  // NOTE: registers must not be cached, the identity map covers them with a cacheable 4 MiB page
+  if (Paging::activePaging != 0)
+    Paging::activePaging->MapPage(
+        base, base, Paging::PAGE_GLOBAL | Paging::PAGE_CACHE_DISABLE | Paging::PAGE_WRITABLE
+    );
+  registers = (volatile uint32_t*)base;
+
+  Write(REGISTER_TPR, 0);                                // accept every priority
+  Write(REGISTER_LVT_LINT0, 0x700);                      // ExtINT, the 8259 PIC (virtual wire)
+  Write(REGISTER_LVT_LINT1, 0x400);                      // NMI
+  Write(REGISTER_LVT_TIMER, 1 << 16);                    // masked
+  Write(REGISTER_SPURIOUS, (1 << 8) | SPURIOUS_VECTOR);  // software enable
+
+  activeLocalAPIC = this;
+  printf(LIGHT_GRAY_COLOR, BLACK_COLOR, "[APIC] Local APIC %d enabled\n", GetID());
+}
+
+
+LocalAPIC::~LocalAPIC() {
+  if (activeLocalAPIC == this) activeLocalAPIC = 0;
+}
+
+
+uint32_t LocalAPIC::Read(uint32_t reg) {
+  return registers[reg / 4];
+}
+
+
+void LocalAPIC::Write(uint32_t reg, uint32_t value) {
+  registers[reg / 4] = value;
+}
+
+
+bool LocalAPIC::IsPresent() {
+  return registers != 0;
+}
+
+
+uint8_t LocalAPIC::GetID() {
+  return Read(REGISTER_ID) >> 24;
+}
+
+
+void LocalAPIC::EndOfInterrupt() {
+  Write(REGISTER_EOI, 0);
+}
+
+
+/**
+ * [calibrates the timer against the TSC clock and lets it drive the kernel tick]
+ * NOTE: call before InterruptManager::Activate(), PIT IRQ0 is masked from here on
+ */
+bool LocalAPIC::StartTimer(ProgrammableIntervalTimer* pit) {
+  Clock* clock = Clock::activeClock;
+  if (registers == 0 || clock == 0 || !clock->HasTSC()) {
+    printf(LIGHT_GRAY_COLOR, BLACK_COLOR, "[APIC] timer not calibrated, the PIT keeps the tick\n");
+    return false;
+  }
+
+  uint32_t nsPerTick = 1000000000 / pit->GetFrequency();
+
+  // count down one tick's worth of nanoseconds from the top
+  Write(REGISTER_TIMER_DIVIDE, 0x3);  // bus clock / 16
+  Write(REGISTER_LVT_TIMER, (1 << 16) | (interrupts->HardwareInterruptOffset() + TIMER_INTERRUPT));
+  Write(REGISTER_TIMER_INITIAL, 0xFFFFFFFF);
+  clock->Delay(nsPerTick);
+  uint32_t counts = 0xFFFFFFFF - Read(REGISTER_TIMER_CURRENT);
+  Write(REGISTER_TIMER_INITIAL, 0);
+
+  if (counts < 100) {
+    printf(LIGHT_GRAY_COLOR, BLACK_COLOR, "[APIC] timer calibration failed, the PIT keeps the tick\n");
+    return false;
+  }
+
+  this->pit = pit;
+  countPerTick = counts;
+  interrupts->SetIRQMask(0, true);
+
+  // NOTE: one-shot, re-armed by every tick so the idle loop can stretch a single period
+  Write(REGISTER_LVT_TIMER, interrupts->HardwareInterruptOffset() + TIMER_INTERRUPT);
+  armedTicks[0] = 1;
+  Write(REGISTER_TIMER_INITIAL, countPerTick);
+
+  printf(
+      LIGHT_GRAY_COLOR,
+      BLACK_COLOR,
+      "[APIC] timer: %d counts per tick, took over from PIT IRQ0\n",
+      countPerTick
+  );
+  return true;
+}
+
+
+bool LocalAPIC::IsTimerRunning() {
+  return countPerTick != 0;
+}
+
+
+/**
+ * [brings up the Local APIC of the calling application processor like the constructor and StartTimer()
+ * did on the bootstrap processor, the timer count is the one calibrated there]
+ * NOTE: LINT0 stays masked, the 8259 PIC interrupts go to the bootstrap processor only
+ */
+void LocalAPIC::InitAP() {
+  if (registers == 0) return;
+
+  uint32_t low, high;
+  asm volatile("rdmsr" : "=a"(low), "=d"(high) : "c"(0x1B));
+  asm volatile("wrmsr" : : "a"(low | (1 << 11)), "d"(high), "c"(0x1B));
+
+  Write(REGISTER_TPR, 0);
+  Write(REGISTER_LVT_LINT0, 1 << 16);  // masked
+  Write(REGISTER_LVT_LINT1, 0x400);    // NMI
+  Write(REGISTER_LVT_TIMER, 1 << 16);
+  Write(REGISTER_SPURIOUS, (1 << 8) | SPURIOUS_VECTOR);
+  if (countPerTick == 0) return;
+
+  uint32_t cpu = CPU::Current();
+  idle[cpu] = false;
+  armedTicks[cpu] = 1;
+  Write(REGISTER_TIMER_DIVIDE, 0x3);
+  Write(REGISTER_LVT_TIMER, interrupts->HardwareInterruptOffset() + TIMER_INTERRUPT);
+  Write(REGISTER_TIMER_INITIAL, countPerTick);
+}
+
+
+/**
+ * [sends an inter-processor interrupt, e.g. INIT (0x4500), STARTUP (0x4600 | page) or a fixed vector]
+ * NOTE: waits for the previous one to be delivered first, interrupts must be disabled
+ */
+void LocalAPIC::SendIPI(uint8_t apicID, uint32_t command) {
+  while (Read(REGISTER_ICR_LOW) & (1 << 12)) asm volatile("pause");  // delivery status: send pending
+  Write(REGISTER_ICR_HIGH, (uint32_t)apicID << 24);
+  Write(REGISTER_ICR_LOW, command);  // NOTE: writing the low dword sends it
+}
+
+
+void LocalAPIC::Credit(uint32_t elapsed) {
+  if (CPU::Current() == 0)
+    pit->Tick(elapsed);
+  else if (TaskManager::activeTaskManager != 0)
+    TaskManager::activeTaskManager->TickLocal(elapsed);
+}
+
+
+/**
+ * [timer interrupt: credits the ticks the expired count stood for, then arms the next tick]
+ */
+uint32_t LocalAPIC::HandleInterrupt(uint32_t esp) {
+  if (countPerTick == 0) {
+    EndOfInterrupt();
+    return esp;
+  }
+
+  uint32_t cpu = CPU::Current();
+  uint32_t elapsed = armedTicks[cpu];
+  armedTicks[cpu] = 1;
+  Write(REGISTER_TIMER_INITIAL, countPerTick);
+  EndOfInterrupt();
+
+  Credit(elapsed);
+  idle[cpu] = false;  // NOTE: after the credit, SMP::SyncTick() waits for it
+  return esp;
+}
+
+
+/**
+ * [tickless idle: stretches the running count to the next sleeper or kernel timer]
+ * the part of the current tick that is left stays, whole ticks are added on top of it.
+ * the application processors have neither, they sleep until an IPI or the longest count
+ */
+void LocalAPIC::EnterIdle() {
+  uint32_t cpu = CPU::Current();
+  if (countPerTick == 0 || idle[cpu]) return;
+
+  uint32_t ticks = (cpu == 0) ? pit->GetTicksUntilNextEvent() : 0xFFFFFFFF;
+  if (ticks <= 1) return;
+
+  uint32_t current = Read(REGISTER_TIMER_CURRENT);
+  if (current == 0) return;  // NOTE: expired, the interrupt is pending
+
+  uint32_t maxTicks = (0xFFFFFFFF - current) / countPerTick + 1;
+  if (ticks > maxTicks) ticks = maxTicks;
+
+  Write(REGISTER_TIMER_INITIAL, current + (ticks - 1) * countPerTick);
+  armedTicks[cpu] = ticks;
+  if (cpu == 0 && TaskManager::activeTaskManager != 0)
+    idleUntil = TaskManager::activeTaskManager->GetTicks() + ticks;
+  idle[cpu] = true;
+}
+
+
+/**
+ * [ends a tickless idle period early: credits the whole ticks that have passed and re-arms the timer for
+ * the end of the current one]
+ * NOTE: the InterruptManager calls it on every interrupt but the timer's own, interrupts are disabled
+ */
+void LocalAPIC::ExitIdle() {
+  uint32_t cpu = CPU::Current();
+  if (!idle[cpu]) return;
+
+  uint32_t current = Read(REGISTER_TIMER_CURRENT);
+  if (current == 0) return;  // NOTE: expired meanwhile, the pending timer interrupt credits the ticks
+
+  uint32_t remainingTicks = (current - 1) / countPerTick + 1;  // tick boundaries still ahead
+  uint32_t elapsed = armedTicks[cpu] - remainingTicks;
+
+  Write(REGISTER_TIMER_INITIAL, current - (remainingTicks - 1) * countPerTick);
+  armedTicks[cpu] = 1;
+
+  if (elapsed > 0) Credit(elapsed);
+  idle[cpu] = false;  // NOTE: after the credit, SMP::SyncTick() waits for it
+}
+
+
+/**
+ * [true while cpu sleeps in a tickless idle period, on CPU 0 the kernel tick is behind meanwhile]
+ */
+bool LocalAPIC::IsIdle(uint32_t cpu) {
+  return cpu < CPU::MAX_CPUS && idle[cpu];
+}
+
+
+uint32_t LocalAPIC::GetIdleUntil() {
+  return idleUntil;
+}
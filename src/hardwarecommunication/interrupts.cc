@@ -1,5 +1,8 @@
 
+#include <fpu.h>
+#include <hardwarecommunication/apic.h>
 #include <hardwarecommunication/interrupts.h>
+#include <smp.h>
 
 using namespace os;
 using namespace os::common;
@@ -51,6 +54,13 @@ InterruptManager::InterruptManager(
       programmableInterruptControllerSlaveDataPort(0xA1) {
   this->taskManager = taskManager;
   this->hardwareInterruptOffset = hardwareInterruptOffset;
+  for (uint32_t cpu = 0; cpu < CPU::MAX_CPUS; cpu++) {
+    perCPU[cpu].deferredHead = 0;
+    perCPU[cpu].deferredTail = 0;
+    perCPU[cpu].runningDeferredWork = false;
+    perCPU[cpu].interruptDepth = 0;
+  }
+  deferredDropped = 0;
   uint32_t CodeSegment = globalDescriptorTable->CodeSegmentSelector();
 
 
@@ -131,6 +141,20 @@ InterruptManager::InterruptManager(
   SetInterruptDescriptorTableEntry(
       hardwareInterruptOffset + 0x0F, CodeSegment, &HandleInterruptRequest0x0F, 0, IDT_INTERRUPT_GATE
   );
+  SetInterruptDescriptorTableEntry(
+      hardwareInterruptOffset + LocalAPIC::TIMER_INTERRUPT,
+      CodeSegment,
+      &HandleInterruptRequest0x20,
+      0,
+      IDT_INTERRUPT_GATE
+  );
+  SetInterruptDescriptorTableEntry(
+      hardwareInterruptOffset + SMP::RESCHEDULE_INTERRUPT,
+      CodeSegment,
+      &HandleInterruptRequest0x21,
+      0,
+      IDT_INTERRUPT_GATE
+  );
 
   SetInterruptDescriptorTableEntry(0x80, CodeSegment, &HandleInterruptRequest0x80, 0, IDT_INTERRUPT_GATE);
 
@@ -150,16 +174,23 @@ InterruptManager::InterruptManager(
   programmableInterruptControllerMasterDataPort.Write(0x00);
   programmableInterruptControllerSlaveDataPort.Write(0x00);
 
-  InterruptDescriptorTablePointer idt_pointer;
-  idt_pointer.size = 256 * sizeof(GateDescriptor) - 1;
-  idt_pointer.base = (uint32_t)interruptDescriptorTable;
-  asm volatile("lidt %0" : : "m"(idt_pointer));
+  LoadInterruptDescriptorTable();
 }
 
 InterruptManager::~InterruptManager() {
   Deactivate();
 }
 
+/**
+ * [loads the IDT into IDTR, every application processor shares the one table]
+ */
+void InterruptManager::LoadInterruptDescriptorTable() {
+  InterruptDescriptorTablePointer idt_pointer;
+  idt_pointer.size = 256 * sizeof(GateDescriptor) - 1;
+  idt_pointer.base = (uint32_t)interruptDescriptorTable;
+  asm volatile("lidt %0" : : "m"(idt_pointer));
+}
+
 uint16_t InterruptManager::HardwareInterruptOffset() {
   return hardwareInterruptOffset;
 }
@@ -185,6 +216,13 @@ uint32_t InterruptManager::HandleInterrupt(uint8_t interrupt, uint32_t esp) {
 
 
 uint32_t InterruptManager::DoHandleInterrupt(uint8_t interrupt, uint32_t esp) {
+  PerCPU* local = &perCPU[CPU::Current()];
+  local->interruptDepth++;
+
+  // NOTE: the idle loop may have armed the Local APIC timer many ticks ahead, catch the tick up first
+  bool localAPICTimer = interrupt == hardwareInterruptOffset + LocalAPIC::TIMER_INTERRUPT;
+  if (LocalAPIC::activeLocalAPIC != 0 && !localAPICTimer) LocalAPIC::activeLocalAPIC->ExitIdle();
+
   if (handlers[interrupt] != 0) {
     esp = handlers[interrupt]->HandleInterrupt(esp);
   } else if (interrupt != hardwareInterruptOffset) {
@@ -192,15 +230,143 @@ uint32_t InterruptManager::DoHandleInterrupt(uint8_t interrupt, uint32_t esp) {
     printByte(interrupt);
   }
 
-  if (interrupt == hardwareInterruptOffset) {
-    esp = (uint32_t)taskManager->Schedule((CPUState*)esp);
-  }
-
-  // hardware interrupts must be acknowledged
-  if (hardwareInterruptOffset <= interrupt && interrupt < hardwareInterruptOffset + 16) {
+  // hardware interrupts must be acknowledged (the Local APIC timer handler does that itself)
+  bool pic = hardwareInterruptOffset <= interrupt && interrupt < hardwareInterruptOffset + 16;
+  if (pic) {
     programmableInterruptControllerMasterCommandPort.Write(0x20);
     if (hardwareInterruptOffset + 8 <= interrupt) programmableInterruptControllerSlaveCommandPort.Write(0x20);
   }
 
+  // NOTE: after the EOI, so further interrupts (timer, keyboard, ...) can preempt the deferred work
+  if (pic || localAPICTimer) RunDeferredWork();
+
+  local->interruptDepth--;  // NOTE: before the switch, the next task resumes outside of this interrupt
+  if (local->interruptDepth == 0) FPU::LeaveInterrupt();
+
+  // NOTE: scheduled last, and never from an interrupt nested in the deferred work: the drain runs on the
+  // stack of the interrupted task, switching away would stall it until that task runs again.
+  // the outermost interrupt switches once the drain is done.
+  if (!local->runningDeferredWork && taskManager->NeedsReschedule()) {
+    esp = (uint32_t)taskManager->Schedule((CPUState*)esp);
+  }
+
   return esp;
 }
+
+
+/**
+ * [queues function(argument) to run after the current interrupt, with interrupts enabled]
+ * e.g.:
+ * InterruptManager::Defer(&amd_am79c973::PollDeferred, this);  // from HandleInterrupt()
+ * NOTE: callable from handlers and from normal code, work is run in FIFO order. with no active manager
+ * the work runs immediately.
+ */
+bool InterruptManager::Defer(void (*function)(void*), void* argument) {
+  InterruptManager* manager = ActiveInterruptManager;
+  if (manager == 0) {
+    function(argument);
+    return true;
+  }
+
+  uint32_t eflags = SaveInterrupts();
+  PerCPU* local = &manager->perCPU[CPU::Current()];
+  uint32_t next = (local->deferredTail + 1) & (MAX_DEFERRED_WORK - 1);
+  if (next == local->deferredHead) {
+    manager->deferredDropped++;
+    RestoreInterrupts(eflags);
+    return false;
+  }
+
+  local->deferredWork[local->deferredTail].function = function;
+  local->deferredWork[local->deferredTail].argument = argument;
+  local->deferredTail = next;
+  RestoreInterrupts(eflags);
+  return true;
+}
+
+
+/**
+ * [true while running an interrupt handler or deferred work, both run on the stack of the interrupted
+ * task, so they must not Sleep() or Block()]
+ */
+bool InterruptManager::InInterrupt() {
+  InterruptManager* manager = ActiveInterruptManager;
+  if (manager == 0) return false;
+
+  uint32_t eflags = SaveInterrupts();
+  PerCPU* local = &manager->perCPU[CPU::Current()];
+  bool inInterrupt = local->interruptDepth > 0 || local->runningDeferredWork;
+  RestoreInterrupts(eflags);
+  return inInterrupt;
+}
+
+
+uint32_t InterruptManager::InterruptDepth() {
+  InterruptManager* manager = ActiveInterruptManager;
+  if (manager == 0) return 0;
+
+  uint32_t eflags = SaveInterrupts();
+  PerCPU* local = &manager->perCPU[CPU::Current()];
+  uint32_t depth = local->interruptDepth + (local->runningDeferredWork ? 1 : 0);
+  RestoreInterrupts(eflags);
+  return depth;
+}
+
+
+/**
+ * [masks or unmasks one of the 16 IRQ lines at the 8259 PIC]
+ */
+void InterruptManager::SetIRQMask(uint8_t irq, bool masked) {
+  Port8BitSlow& port = irq < 8 ? programmableInterruptControllerMasterDataPort
+                               : programmableInterruptControllerSlaveDataPort;
+  uint8_t bit = 1 << (irq & 7);
+
+  uint32_t eflags = SaveInterrupts();
+  uint8_t mask = port.Read();
+  port.Write(masked ? (mask | bit) : (mask & ~bit));
+  RestoreInterrupts(eflags);
+}
+
+
+/**
+ * [the calling CPU's queue, call with interrupts disabled]
+ */
+bool InterruptManager::HasDeferredWork() {
+  PerCPU* local = &perCPU[CPU::Current()];
+  return local->deferredHead != local->deferredTail;
+}
+
+
+/**
+ * [runs up to DEFERRED_WORK_BUDGET items of the calling CPU's queue with interrupts enabled]
+ * an interrupt arriving meanwhile only queues more work, the drain further down the stack picks it up,
+ * so hard IRQ latency stays bounded. whatever is left over runs on the next interrupt or in the idle loop.
+ * NOTE: the CPU cannot change meanwhile, the drain never switches tasks (see DoHandleInterrupt())
+ */
+void InterruptManager::RunDeferredWork() {
+  uint32_t eflags = SaveInterrupts();
+  PerCPU* local = &perCPU[CPU::Current()];
+  if (local->runningDeferredWork) {
+    RestoreInterrupts(eflags);
+    return;
+  }
+  local->runningDeferredWork = true;
+
+  for (uint32_t budget = DEFERRED_WORK_BUDGET; budget > 0 && local->deferredHead != local->deferredTail;
+       budget--) {
+    DeferredWork work = local->deferredWork[local->deferredHead];
+    local->deferredHead = (local->deferredHead + 1) & (MAX_DEFERRED_WORK - 1);
+
+    asm volatile("sti");
+    work.function(work.argument);
+    asm volatile("cli");
+  }
+
+  local->runningDeferredWork = false;
+  RestoreInterrupts(eflags);
+}
+
+
+uint32_t InterruptManager::GetDeferredDropped() {
+  return deferredDropped;
+}
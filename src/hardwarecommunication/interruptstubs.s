@@ -7,10 +7,21 @@
 .extern _ZN2os21hardwarecommunication16InterruptManager15HandleInterruptEhj
 
 
+# NOTE: the vector is pushed, not stored in a global, every CPU takes interrupts on its own stack
 .macro HandleException num
 .global _ZN2os21hardwarecommunication16InterruptManager19HandleException\num\()Ev
 _ZN2os21hardwarecommunication16InterruptManager19HandleException\num\()Ev:
-    movb $\num, (interruptnumber)
+    pushl $0
+    pushl $\num
+    jmp int_bottom
+.endm
+
+
+# exceptions 0x08, 0x0A - 0x0E and 0x11 push an error code themselves
+.macro HandleExceptionWithErrorCode num
+.global _ZN2os21hardwarecommunication16InterruptManager19HandleException\num\()Ev
+_ZN2os21hardwarecommunication16InterruptManager19HandleException\num\()Ev:
+    pushl $\num
     jmp int_bottom
 .endm
 
@@ -18,8 +29,8 @@ _ZN2os21hardwarecommunication16InterruptManager19HandleException\num\()Ev:
 .macro HandleInterruptRequest num
 .global _ZN2os21hardwarecommunication16InterruptManager26HandleInterruptRequest\num\()Ev
 _ZN2os21hardwarecommunication16InterruptManager26HandleInterruptRequest\num\()Ev:
-    movb $\num + IRQ_BASE, (interruptnumber)
     pushl $0
+    pushl $\num + IRQ_BASE
     jmp int_bottom
 .endm
 
@@ -32,16 +43,16 @@ HandleException 0x04
 HandleException 0x05
 HandleException 0x06
 HandleException 0x07
-HandleException 0x08
+HandleExceptionWithErrorCode 0x08
 HandleException 0x09
-HandleException 0x0A
-HandleException 0x0B
-HandleException 0x0C
-HandleException 0x0D
-HandleException 0x0E
+HandleExceptionWithErrorCode 0x0A
+HandleExceptionWithErrorCode 0x0B
+HandleExceptionWithErrorCode 0x0C
+HandleExceptionWithErrorCode 0x0D
+HandleExceptionWithErrorCode 0x0E
 HandleException 0x0F
 HandleException 0x10
-HandleException 0x11
+HandleExceptionWithErrorCode 0x11
 HandleException 0x12
 HandleException 0x13
 
@@ -63,6 +74,8 @@ HandleInterruptRequest 0x0C
 HandleInterruptRequest 0x0D
 HandleInterruptRequest 0x0E
 HandleInterruptRequest 0x0F
+HandleInterruptRequest 0x20
+HandleInterruptRequest 0x21
 HandleInterruptRequest 0x31
 
 HandleInterruptRequest 0x80
@@ -91,13 +104,19 @@ int_bottom:
     #mov %eax, %eds
     #mov %eax, %ees
 
+    # the C++ handlers expect DF clear, the interrupted code may be in memmove()'s backward copy
+    cld
+
     # call C++ Handler
     pushl %esp
-    push (interruptnumber)
+    pushl 32(%esp) # the vector, above the 7 registers and the esp just pushed
     call _ZN2os21hardwarecommunication16InterruptManager15HandleInterruptEhj
     #add %esp, 6
     mov %eax, %esp # switch the stack
 
+    # the previous task's stack is no longer in use, another CPU may resume it now
+    call _ZN2os11TaskManager12FinishSwitchEv
+
     # restore registers
     popl %eax
     popl %ebx
@@ -113,13 +132,10 @@ int_bottom:
     #pop %ds
     #popa
     
-    add $4, %esp
+    add $8, %esp # vector and error code
 
 .global _ZN2os21hardwarecommunication16InterruptManager15InterruptIgnoreEv
 _ZN2os21hardwarecommunication16InterruptManager15InterruptIgnoreEv:
 
     iret
 
-
-.data
-    interruptnumber: .byte 0
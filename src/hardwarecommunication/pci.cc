@@ -162,12 +162,9 @@ Driver* PeripheralComponentInterconnectController::GetDriver(
           // printf("AMD am79c973: ");
           EnableBusMastering(&dev);  // enable bus mastering DMA so the PCI device can access RAM
           // driver = (Driver*)MemoryManager::activeMemoryManager->malloc(sizeof(amd_am79c973));
+          // NOTE: constructed exactly once, a second (placement) construction leaked the DMA rings
           driver = new amd_am79c973(&dev, interrupts);
-          if (driver != 0) {
-            new (driver) amd_am79c973(&dev, interrupts);
-            // printf("amd_am79c973 driver address: %x\n", (uint32_t)driver);
-            // printf("AMD am79c973 driver created");
-          }
+          // printf("amd_am79c973 driver address: %x\n", (uint32_t)driver);
           return driver;
           break;
       }
@@ -5,24 +5,33 @@
 #include <common/types.h>
 #include <drivers/amd_am79c973.h>
 #include <drivers/ata.h>
+#include <drivers/clock.h>
 #include <drivers/driver.h>
 #include <drivers/keyboard.h>
 #include <drivers/mouse.h>
 #include <drivers/terminal.h>
 #include <drivers/timer.h>
 #include <drivers/vga.h>
+#include <fpu.h>
 #include <gdt.h>
 #include <gui/desktop.h>
 #include <gui/window.h>
+#include <hardwarecommunication/apic.h>
 #include <hardwarecommunication/interrupts.h>
 #include <hardwarecommunication/pci.h>
+#include <memory/buddy.h>
+#include <memory/frameallocator.h>
+#include <memory/paging.h>
 #include <memorymanagement.h>
 #include <multitasking.h>
 #include <net/arp.h>
 #include <net/etherframe.h>
 #include <net/icmp.h>
 #include <net/ipv4.h>
+#include <net/netbuffer.h>
+#include <smp.h>
 #include <syscalls.h>
+#include <workqueue.h>
 #include <utils/ds/hashmap.h>
 #include <utils/print.h>
 #include <utils/string.h>
@@ -41,6 +50,7 @@ using namespace os::gui;
 using namespace os::net;
 using namespace os::cli;
 using namespace os::ciu;
+using namespace os::memory;
 
 
 // Console Event Handlers
@@ -206,6 +216,55 @@ void TestHashTable() {
   }
 }
 
+
+/* NOTE: SMP sleep test, threads sleep one tick at a time. the ones running on an application processor
+ * race CPU 0's tick between Sleep()'s Unlock() and its switch away, a task queued twice there corrupts
+ * the run queue (lost or duplicated wakeups, hangs)
+ */
+static const uint32_t SLEEP_TEST_THREADS = 8;
+static const uint32_t SLEEP_TEST_ROUNDS = 500;
+static volatile uint32_t sleepTestRoundsOnAPs = 0;
+static volatile uint32_t sleepTestErrors = 0;
+
+void SleepTestThread(void* argument) {
+  TaskManager* taskManager = (TaskManager*)argument;
+  for (uint32_t i = 0; i < SLEEP_TEST_ROUNDS; i++) {
+    uint32_t before = taskManager->GetTicks();
+    taskManager->Sleep(1);
+    if ((int32_t)(taskManager->GetTicks() - before) < 1) __sync_fetch_and_add(&sleepTestErrors, 1);
+    if (taskManager->GetCurrentTask()->GetState() != TaskState::Runnable)
+      __sync_fetch_and_add(&sleepTestErrors, 1);
+
+    asm volatile("cli");
+    if (CPU::Current() != 0) __sync_fetch_and_add(&sleepTestRoundsOnAPs, 1);
+    asm volatile("sti");
+  }
+}
+
+void TestSMPSleep(TaskManager* taskManager) {
+  printf(YELLOW_COLOR, BLACK_COLOR, "INITIALIZING SMP SLEEP TEST (%d CPUs)...\n", CPU::Count());
+
+  Task* threads[SLEEP_TEST_THREADS];
+  uint32_t started = 0;
+  for (uint32_t i = 0; i < SLEEP_TEST_THREADS; i++) {
+    threads[i] = taskManager->CreateThread(&SleepTestThread, taskManager);
+    if (threads[i] != 0) started++;
+  }
+  for (uint32_t i = 0; i < SLEEP_TEST_THREADS; i++)
+    if (threads[i] != 0) taskManager->Join(threads[i]);
+
+  if (started == SLEEP_TEST_THREADS && sleepTestErrors == 0) {
+    printf(LIGHT_GREEN_COLOR, BLACK_COLOR, "[PASS] %d Sleep(1) rounds, %d of them on APs.\n",
+           SLEEP_TEST_THREADS * SLEEP_TEST_ROUNDS, sleepTestRoundsOnAPs);
+  } else {
+    printf(RED_COLOR, BLACK_COLOR, "[FAIL] %d/%d threads started, %d early or non-runnable wakeups.\n",
+           started, SLEEP_TEST_THREADS, sleepTestErrors);
+  }
+  if (CPU::Count() > 1 && sleepTestRoundsOnAPs == 0)
+    printf(RED_COLOR, BLACK_COLOR, "[FAIL] no round ran on an AP.\n");
+}
+
+
 typedef void (*constructor)();
 extern "C" constructor start_ctors;
 extern "C" constructor end_ctors;
@@ -222,22 +281,28 @@ extern "C" void kernelMain(const void* multiboot_structure, uint32_t /*multiboot
 
   GlobalDescriptorTable gdt;
 
-  // clang-format off
-  uint32_t* memupper = (uint32_t*)(((size_t)multiboot_structure) + 8);  // HACK: find the upper memory bound in kilobytes, based on multiboot_info struct from GNU
-  // clang-format on
-  size_t heapStart = 10 * 1024 * 1024;  // NOTE: start of heap is at 10 MiB, address: 0x00A00000
-  size_t padding = 10 * 1024;           // NOTE: padding is 10 KiB
-  size_t heapSize = (*memupper) * 1024 - heapStart -
-                    padding;  // NOTE: (*memupper) returns the total RAM above 1 MB, multiplying by
-                              // 1024 converts total available RAM above 1 MB to bytes
-  // NOTE: on a 512 MB RAM system, heapSize := 500 MB => (512 MB - ~1 MB) - 10 MiB - 10 KiB = 500 MB
-  /* DIAGRAM: MEMORYDIMENSION at boot
-   - MEMORYDIMENSION := { [ padding (10 KB)], [ ... ], [ heapStart    ...    heapSize ]}
+  // NOTE: parse the full multiboot memory map, every usable 4 KiB frame (above 1 MiB, outside the kernel
+  // image and around any memory holes) is tracked in a bitmap
+  PhysicalFrameAllocator frames(multiboot_structure);
+  printf(
+      "Physical Memory: %d MiB usable (%d frames free)\n",
+      frames.GetTotalFrames() / 256,  // NOTE: 256 frames of 4 KiB = 1 MiB
+      frames.GetFreeFrames()
+  );
 
+  // NOTE: the heap no longer owns one fixed region, it starts at 1 MiB and grows page by page from frames
+  /* DIAGRAM: MEMORYDIMENSION at boot
+   - MEMORYDIMENSION := { [ low memory (1 MiB)], [ kernel image ], [ heap regions ... free frames ... ]}
   */
-  MemoryManager heap(heapStart, heapSize);
+  MemoryManager heap(&frames, 1024 * 1024);
+
+  // NOTE: large, aligned and physically contiguous buffers (NIC rings, DMA) come from a separate buddy arena
+  // so they don't fragment the small-object heap, must exist before any driver is constructed
+  BuddyAllocator buddy(&frames, 8 * 1024 * 1024);
 
-  printf("Heap Start: 0x%08x = %d MiB\n", heapStart, (heapStart / (1024 * 1024)));
+  // NOTE: identity map all 4 GiB with 4 MiB pages (page 0 stays unmapped), addresses stay the same
+  Paging paging(&frames);
+  paging.Activate();
 
   // printf("\nheap start: 0x"); // 10 MiB heap start should be: 0x00A0000
   // printfHex((heapStart >> 3*8) & 0xFF); // byte 3 (MSB) => 0x00 & 0xFF = 0x00
@@ -250,16 +315,20 @@ extern "C" void kernelMain(const void* multiboot_structure, uint32_t /*multiboot
 
 
   // Multitasking/
-  TaskManager taskManager;
+  TaskManager taskManager(&gdt);
   Task task1(&gdt, taskA);
   Task task2(&gdt, taskB);
   /*
   taskManager.AddTask(&task1);
   taskManager.AddTask(&task2);
   */
+  // worker thread for slow or blocking jobs (shell commands), interactive so it preempts CPU-bound tasks
+  WorkQueue workQueue(&taskManager, 1, Task::PRIORITY_HIGH);
 
   InterruptManager interrupts(0x20, &gdt, &taskManager);
   SyscallHandler syscalls(&interrupts, 0x80);
+  PageFaultHandler pageFaultHandler(&interrupts);
+  FPU fpu(&interrupts);  // lazy x87/SSE switching, #NM
 
   // printf("Initializing Hardware, Stage 1\n");
 #ifdef GRAPHICSMODE
@@ -273,8 +342,11 @@ extern "C" void kernelMain(const void* multiboot_structure, uint32_t /*multiboot
 
   CommandRegistry commandRegistry;
 
-  ProgrammableIntervalTimer timer(&interrupts, 100);  // [PIT timer, frequency := 1000Hz => tick = 1ms]
+  ProgrammableIntervalTimer timer(&interrupts, 100);  // [PIT timer, frequency := 100Hz => tick = 10ms]
   uint64_t startTicks = timer.ticks;                  // [tracks ticks passed from boot]
+  Clock clock(&timer);                                // [TSC ns clock, calibrated on PIT channel 2]
+  LocalAPIC localAPIC(&interrupts);
+  localAPIC.StartTimer(&timer);  // NOTE: the LAPIC one-shot timer drives the tick from here on, not IRQ0
 
 #ifdef GRAPHICSMODE
   MouseDriver mouse(&interrupts, &desktop);  // NOTE: handler: &desktop attaches the mouse to the desktop
@@ -374,6 +446,8 @@ extern "C" void kernelMain(const void* multiboot_structure, uint32_t /*multiboot
 
   eth0->SetIPAddress(ip_BE);  // tell network card that this is our IP
 
+  NetBufferPool netBuffers(64);  // preallocated packet buffers for the TX path (128 KiB)
+
   EtherFrameProvider etherframe(eth0);  // communicates with network card
 
   AddressResolutionProtocol arp(&etherframe);  // communicates with etherframe provider middle-layer
@@ -442,6 +516,12 @@ extern "C" void kernelMain(const void* multiboot_structure, uint32_t /*multiboot
   // activate interupts last
   interrupts.Activate();
 
+  // NOTE: the application processors come up last, they share the IDT and take the LAPIC timer's rate
+  SMP smp(&gdt, &interrupts, &localAPIC, &taskManager);
+  smp.StartAPs();
+
+  // TestSMPSleep(&taskManager);  // NOTE: needs the APs up and interrupts on, run with "-smp 2" or more
+
 
   char* send_data = "7777777";
   // arp.Resolve(gip_BE);
@@ -461,7 +541,16 @@ extern "C" void kernelMain(const void* multiboot_structure, uint32_t /*multiboot
   printf(WHITE_COLOR, BLACK_COLOR, "ALL SYSTEMS GO\n");
   shell.PrintPrompt();
   while (1) {
-    asm volatile("hlt");  // halt cpu until next interrupt, saving power and does not max out cpu usage
+    // NOTE: deferred interrupt work that did not fit into an interrupt's budget runs here
+    // "sti; hlt" is atomic, an interrupt that queues work after the check still wakes the loop
+    asm volatile("cli");
+    if (interrupts.HasDeferredWork()) {
+      asm volatile("sti");
+      interrupts.RunDeferredWork();
+      continue;
+    }
+    localAPIC.EnterIdle();     // NOTE: tickless, no timer interrupt until the next sleeper or timer
+    asm volatile("sti; hlt");  // halt cpu until next interrupt, saving power and does not max out cpu usage
 // using "hlt" is better than an while(1) infinite loop because it does not waste CPU cycles, generate
 // heat, drain battery/power, etc.
 #ifdef GRAPHICSMODE
@@ -0,0 +1,166 @@
+#include <memory/buddy.h>
+
+using namespace os;
+using namespace os::common;
+using namespace os::memory;
+
+BuddyAllocator* BuddyAllocator::activeBuddyAllocator = 0;
+
+
+/**
+ * [takes arenaSize bytes (rounded up to 4 MiB blocks) from the frame allocator]
+ * e.g.:
+ * BuddyAllocator buddy(&frames, 8 * 1024 * 1024);
+ * void* ring = buddy.AllocContiguous(16 * 1024, 16);
+ * NOTE: if that much contiguous memory is not available, the arena is halved until it fits
+ */
+BuddyAllocator::BuddyAllocator(PhysicalFrameAllocator* frames, uint32_t arenaSize) {
+  activeBuddyAllocator = this;
+
+  for (uint32_t i = 0; i < NUM_ORDERS; i++) freeLists[i] = 0;
+  freeListBitmap = 0;
+  freePages = 0;
+  base = 0;
+  pages = 0;
+  pageMap = 0;
+
+  uint32_t blocks = (arenaSize + MAX_BLOCK_SIZE - 1) / MAX_BLOCK_SIZE;
+  for (; blocks > 0; blocks /= 2) {
+    base = frames->AllocFrames(blocks << MAX_ORDER, 1 << MAX_ORDER);
+    if (base != 0) break;
+  }
+  if (base == 0) return;
+
+  pages = blocks << MAX_ORDER;
+  pageMap = new uint8_t[pages];
+  for (uint32_t i = 0; i < pages; i++) pageMap[i] = 0;
+
+  for (uint32_t i = 0; i < blocks; i++) Push(base + i * MAX_BLOCK_SIZE, MAX_ORDER);
+  freePages = pages;
+}
+
+
+BuddyAllocator::~BuddyAllocator() {
+  if (activeBuddyAllocator == this) activeBuddyAllocator = 0;
+  if (pageMap != 0) delete[] pageMap;
+}
+
+
+void BuddyAllocator::Push(uint32_t address, uint32_t order) {
+  FreeBlock* block = (FreeBlock*)address;
+  block->prev = 0;
+  block->next = freeLists[order];
+  if (block->next != 0) block->next->prev = block;
+  freeLists[order] = block;
+  freeListBitmap |= (1u << order);
+
+  pageMap[(address - base) / PAGE_SIZE] = PAGE_FREE | order;
+}
+
+
+void BuddyAllocator::Remove(uint32_t address, uint32_t order) {
+  FreeBlock* block = (FreeBlock*)address;
+  if (block->prev != 0)
+    block->prev->next = block->next;
+  else
+    freeLists[order] = block->next;
+  if (block->next != 0) block->next->prev = block->prev;
+  if (freeLists[order] == 0) freeListBitmap &= ~(1u << order);
+
+  pageMap[(address - base) / PAGE_SIZE] = order;
+}
+
+
+uint32_t BuddyAllocator::OrderOf(uint32_t size) {
+  if (size > MAX_BLOCK_SIZE) return NUM_ORDERS;  // NOTE: too large for any block
+
+  uint32_t order = 0;
+  while ((PAGE_SIZE << order) < size) order++;
+  return order;
+}
+
+
+/**
+ * [allocates one block of 4 KiB << order, splitting a larger block if needed]
+ * O(log n): the smallest non-empty order is found with one bsf, then split at most MAX_ORDER times
+ */
+uint32_t BuddyAllocator::Alloc(uint32_t order) {
+  if (order > MAX_ORDER) return 0;
+
+  uint32_t candidates = freeListBitmap & ~((1u << order) - 1);
+  if (candidates == 0) return 0;
+
+  uint32_t current;
+  asm("bsf %1, %0" : "=r"(current) : "rm"(candidates));
+
+  uint32_t address = (uint32_t)freeLists[current];
+  Remove(address, current);
+
+  // NOTE: keep the lower half, the upper half (its buddy) goes back onto the next smaller free list
+  while (current > order) {
+    current--;
+    Push(address + (PAGE_SIZE << current), current);
+  }
+  pageMap[(address - base) / PAGE_SIZE] = order;  // allocated, Free() reads the order back from here
+
+  freePages -= (1u << order);
+  return address;
+}
+
+
+/**
+ * [returns a block and merges it with its buddy as long as the buddy is free and of the same order]
+ */
+void BuddyAllocator::Free(uint32_t address) {
+  if (address < base || address >= base + pages * PAGE_SIZE) return;
+
+  uint32_t index = (address - base) / PAGE_SIZE;
+  if (pageMap[index] & PAGE_FREE) return;  // NOTE: double free, ignore
+
+  uint32_t order = pageMap[index] & PAGE_ORDER_MASK;
+  freePages += (1u << order);
+
+  while (order < MAX_ORDER) {
+    // the buddy of a block differs only in the bit of the block size
+    uint32_t buddy = base + ((address - base) ^ (PAGE_SIZE << order));
+    uint8_t buddyState = pageMap[(buddy - base) / PAGE_SIZE];
+    if (!(buddyState & PAGE_FREE) || (buddyState & PAGE_ORDER_MASK) != order) break;
+
+    Remove(buddy, order);
+    if (buddy < address) address = buddy;
+    order++;
+  }
+
+  Push(address, order);
+}
+
+
+/**
+ * [allocates size bytes of physically contiguous memory, aligned to align]
+ * blocks are naturally aligned to their size, so the order only has to cover both size and align
+ */
+void* BuddyAllocator::AllocContiguous(uint32_t size, uint32_t align) {
+  if (size == 0) size = 1;
+
+  uint32_t order = OrderOf(size);
+  uint32_t alignOrder = OrderOf(align);
+  if (alignOrder > order) order = alignOrder;
+
+  return (void*)Alloc(order);
+}
+
+
+void BuddyAllocator::FreeContiguous(void* ptr) {
+  if (ptr == 0) return;
+  Free((uint32_t)ptr);
+}
+
+
+uint32_t BuddyAllocator::GetArenaSize() {
+  return pages * PAGE_SIZE;
+}
+
+
+uint32_t BuddyAllocator::GetFreeBytes() {
+  return freePages * PAGE_SIZE;
+}
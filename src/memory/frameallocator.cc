@@ -0,0 +1,180 @@
+#include <memory/frameallocator.h>
+
+using namespace os;
+using namespace os::common;
+using namespace os::memory;
+
+// NOTE: defined in linker.ld, the addresses (not the values) mark the boundaries of the kernel image
+extern "C" uint32_t kernel_start;
+extern "C" uint32_t kernel_end;
+
+uint32_t PhysicalFrameAllocator::bitmap[PhysicalFrameAllocator::MAX_FRAMES / 32];
+PhysicalFrameAllocator* PhysicalFrameAllocator::activeFrameAllocator = 0;
+
+
+PhysicalFrameAllocator::PhysicalFrameAllocator(const void* multiboot_structure) {
+  activeFrameAllocator = this;
+
+  totalFrames = 0;
+  freeFrames = 0;
+  searchHint = 0;
+
+  // everything starts out reserved, only ranges the bootloader reports as RAM are released
+  for (uint32_t i = 0; i < MAX_FRAMES / 32; i++) bitmap[i] = 0xFFFFFFFF;
+
+  const MultibootInfo* info = (const MultibootInfo*)multiboot_structure;
+
+  if (info->flags & MULTIBOOT_INFO_MEMORY_MAP) {
+    // walk the full memory map so RAM above any hole is found as well
+    uint32_t entryAddress = info->mmapAddr;
+    while (entryAddress < info->mmapAddr + info->mmapLength) {
+      const MultibootMemoryMapEntry* entry = (const MultibootMemoryMapEntry*)entryAddress;
+      if (entry->type == MULTIBOOT_MEMORY_AVAILABLE) ReleaseRange(entry->baseAddress, entry->length);
+      entryAddress += entry->size + sizeof(entry->size);
+    }
+  } else if (info->flags & MULTIBOOT_INFO_MEMORY) {
+    // HACK: no memory map, fall back to the contiguous block above 1 MiB
+    ReleaseRange(0x100000, (uint64_t)info->memUpper * 1024);
+  }
+
+  // NOTE: low memory holds the IVT, BIOS data, VGA memory and ROMs, never hand it out
+  ReserveRange(0, 0x100000);
+  // the kernel image, including .bss (kernel stack and this bitmap)
+  ReserveRange((uint32_t)&kernel_start, (uint32_t)&kernel_end - (uint32_t)&kernel_start);
+  // the multiboot structures, in case the bootloader placed them above 1 MiB
+  ReserveRange((uint32_t)info, sizeof(MultibootInfo));
+  if (info->flags & MULTIBOOT_INFO_MEMORY_MAP) ReserveRange(info->mmapAddr, info->mmapLength);
+}
+
+
+PhysicalFrameAllocator::~PhysicalFrameAllocator() {}
+
+
+void PhysicalFrameAllocator::MarkUsed(uint32_t frame) {
+  if (IsUsed(frame)) return;
+  bitmap[frame / 32] |= (1u << (frame % 32));
+  freeFrames--;
+}
+
+
+void PhysicalFrameAllocator::MarkFree(uint32_t frame) {
+  if (!IsUsed(frame)) return;
+  bitmap[frame / 32] &= ~(1u << (frame % 32));
+  freeFrames++;
+}
+
+
+bool PhysicalFrameAllocator::IsUsed(uint32_t frame) {
+  return (bitmap[frame / 32] & (1u << (frame % 32))) != 0;
+}
+
+
+/**
+ * [releases every frame that lies completely inside [base, base + length)]
+ * NOTE: anything above 4 GiB is ignored, this is a 32-bit kernel without PAE
+ */
+void PhysicalFrameAllocator::ReleaseRange(uint64_t base, uint64_t length) {
+  uint64_t end = base + length;
+  if (end > ((uint64_t)MAX_FRAMES << 12)) end = (uint64_t)MAX_FRAMES << 12;
+
+  uint64_t firstFrame = (base + FRAME_SIZE - 1) >> 12;  // round up, partial frames are unusable
+  uint64_t lastFrame = end >> 12;                       // round down
+
+  for (uint64_t frame = firstFrame; frame < lastFrame; frame++) {
+    if (IsUsed((uint32_t)frame)) totalFrames++;
+    MarkFree((uint32_t)frame);
+  }
+}
+
+
+/**
+ * [reserves every frame that overlaps [base, base + length)]
+ */
+void PhysicalFrameAllocator::ReserveRange(uint32_t base, uint32_t length) {
+  if (length == 0) return;
+  uint64_t end = (uint64_t)base + length;
+
+  uint32_t firstFrame = base >> 12;                                   // round down
+  uint32_t lastFrame = (uint32_t)((end + FRAME_SIZE - 1) >> 12);     // round up
+
+  for (uint32_t frame = firstFrame; frame < lastFrame && frame < MAX_FRAMES; frame++) {
+    if (!IsUsed(frame)) totalFrames--;
+    MarkUsed(frame);
+  }
+}
+
+
+/**
+ * [allocates a single frame, full bitmap words (32 used frames) are skipped at once]
+ */
+uint32_t PhysicalFrameAllocator::AllocFrame() {
+  for (uint32_t n = 0; n < MAX_FRAMES / 32; n++) {
+    uint32_t word = (searchHint + n) % (MAX_FRAMES / 32);
+    if (bitmap[word] == 0xFFFFFFFF) continue;
+
+    uint32_t bit;
+    asm("bsf %1, %0" : "=r"(bit) : "rm"(~bitmap[word]));  // lowest free frame within the word
+
+    uint32_t frame = word * 32 + bit;
+    MarkUsed(frame);
+    searchHint = word;
+    return frame * FRAME_SIZE;
+  }
+  return 0;
+}
+
+
+/**
+ * [allocates count physically contiguous frames (first fit), used to grow the heap]
+ * alignment (in frames, power of two) := the first frame number must be a multiple of it
+ */
+uint32_t PhysicalFrameAllocator::AllocFrames(uint32_t count, uint32_t alignment) {
+  if (count == 0) return 0;
+  if (count == 1 && alignment <= 1) return AllocFrame();
+
+  uint32_t runStart = 0;
+  uint32_t runLength = 0;
+  for (uint32_t frame = 0; frame < MAX_FRAMES; frame++) {
+    if ((frame % 32) == 0 && bitmap[frame / 32] == 0xFFFFFFFF) {
+      runLength = 0;
+      frame += 31;
+      continue;
+    }
+
+    if (IsUsed(frame)) {
+      runLength = 0;
+      continue;
+    }
+
+    if (runLength == 0) {
+      if (alignment > 1 && (frame & (alignment - 1)) != 0) continue;  // a run may only start aligned
+      runStart = frame;
+    }
+    if (++runLength == count) {
+      for (uint32_t i = 0; i < count; i++) MarkUsed(runStart + i);
+      return runStart * FRAME_SIZE;
+    }
+  }
+  return 0;
+}
+
+
+void PhysicalFrameAllocator::FreeFrame(uint32_t address) {
+  FreeFrames(address, 1);
+}
+
+
+void PhysicalFrameAllocator::FreeFrames(uint32_t address, uint32_t count) {
+  uint32_t firstFrame = address / FRAME_SIZE;
+  for (uint32_t i = 0; i < count && firstFrame + i < MAX_FRAMES; i++) MarkFree(firstFrame + i);
+}
+
+
+uint32_t PhysicalFrameAllocator::GetTotalFrames() {
+  return totalFrames;
+}
+
+
+uint32_t PhysicalFrameAllocator::GetFreeFrames() {
+  return freeFrames;
+}
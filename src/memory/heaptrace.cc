@@ -0,0 +1,137 @@
+#include <memory/heaptrace.h>
+
+using namespace os;
+using namespace os::common;
+using namespace os::memory;
+
+#ifdef HEAP_TRACE
+
+HeapTraceEntry HeapTrace::entries[HeapTrace::MAX_ENTRIES];
+uint32_t HeapTrace::liveEntries = 0;
+uint32_t HeapTrace::dropped = 0;
+volatile uint64_t* HeapTrace::clock = 0;
+IrqSpinlock HeapTrace::lock;
+
+
+void HeapTrace::SetClock(volatile uint64_t* ticks) {
+  clock = ticks;
+}
+
+
+uint32_t HeapTrace::Now() {
+  return (clock != 0) ? (uint32_t)*clock : 0;
+}
+
+
+/**
+ * [home slot of a pointer, payloads are 8 byte aligned so the low 3 bits carry no information]
+ */
+uint32_t HeapTrace::Slot(void* ptr) {
+  return (((uint32_t)ptr >> 3) * 2654435761u) & (MAX_ENTRIES - 1);  // NOTE: Knuth multiplicative hash
+}
+
+
+void HeapTrace::Record(void* ptr, uint32_t size, void* callsite) {
+  if (ptr == 0) return;
+  uint32_t eflags = lock.Lock();
+
+  // NOTE: keep the table at most 3/4 full, otherwise linear probing gets slow
+  if (liveEntries >= MAX_ENTRIES - MAX_ENTRIES / 4) {
+    dropped++;
+    lock.Unlock(eflags);
+    return;
+  }
+
+  uint32_t slot = Slot(ptr);
+  while (entries[slot].ptr != 0) slot = (slot + 1) & (MAX_ENTRIES - 1);
+
+  entries[slot].ptr = ptr;
+  entries[slot].callsite = (uint32_t)callsite;
+  entries[slot].size = size;
+  entries[slot].tick = Now();
+  liveEntries++;
+  lock.Unlock(eflags);
+}
+
+
+/**
+ * [removes the entry of ptr, later entries of the probe chain are shifted back so lookups never need
+ * tombstones]
+ */
+void HeapTrace::Forget(void* ptr) {
+  if (ptr == 0) return;
+  uint32_t eflags = lock.Lock();
+
+  uint32_t slot = Slot(ptr);
+  while (entries[slot].ptr != ptr) {
+    if (entries[slot].ptr == 0) {
+      lock.Unlock(eflags);
+      return;  // not recorded (dropped, or allocated before tracing)
+    }
+    slot = (slot + 1) & (MAX_ENTRIES - 1);
+  }
+
+  entries[slot].ptr = 0;
+  liveEntries--;
+
+  for (uint32_t next = (slot + 1) & (MAX_ENTRIES - 1); entries[next].ptr != 0;
+       next = (next + 1) & (MAX_ENTRIES - 1)) {
+    uint32_t home = Slot(entries[next].ptr);
+    // the entry may move into the hole if its home slot is not between the hole and its position
+    bool movable = (slot <= next) ? (home <= slot || home > next) : (home <= slot && home > next);
+    if (!movable) continue;
+
+    entries[slot] = entries[next];
+    entries[next].ptr = 0;
+    slot = next;
+  }
+  lock.Unlock(eflags);
+}
+
+
+uint32_t HeapTrace::GetCallsites(HeapTraceCallsite* callsites, uint32_t maxCallsites) {
+  uint32_t count = 0;
+
+  uint32_t eflags = lock.Lock();
+  for (uint32_t i = 0; i < MAX_ENTRIES; i++) {
+    if (entries[i].ptr == 0) continue;
+
+    uint32_t c = 0;
+    while (c < count && callsites[c].callsite != entries[i].callsite) c++;
+    if (c == count) {
+      if (count == maxCallsites) continue;  // NOTE: more distinct callsites than the caller can take
+      callsites[c].callsite = entries[i].callsite;
+      callsites[c].bytes = 0;
+      callsites[c].allocations = 0;
+      callsites[c].oldestTick = entries[i].tick;
+      count++;
+    }
+
+    callsites[c].bytes += entries[i].size;
+    callsites[c].allocations++;
+    if (entries[i].tick < callsites[c].oldestTick) callsites[c].oldestTick = entries[i].tick;
+  }
+  lock.Unlock(eflags);
+
+  // insertion sort by bytes, largest first (count is small)
+  for (uint32_t i = 1; i < count; i++) {
+    HeapTraceCallsite current = callsites[i];
+    uint32_t j = i;
+    for (; j > 0 && callsites[j - 1].bytes < current.bytes; j--) callsites[j] = callsites[j - 1];
+    callsites[j] = current;
+  }
+
+  return count;
+}
+
+
+uint32_t HeapTrace::GetLiveEntries() {
+  return liveEntries;
+}
+
+
+uint32_t HeapTrace::GetDropped() {
+  return dropped;
+}
+
+#endif
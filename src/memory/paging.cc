@@ -0,0 +1,169 @@
+#include <memory/paging.h>
+
+using namespace os;
+using namespace os::common;
+using namespace os::utils;
+using namespace os::memory;
+using namespace os::hardwarecommunication;
+
+Paging* Paging::activePaging = 0;
+bool Paging::hasPSE = false;
+bool Paging::hasPGE = false;
+
+
+/**
+ * [builds the kernel address space, identity mapping all 4 GiB]
+ * without PSE every directory entry gets a page table of 4 KiB pages instead (4 MiB of tables),
+ * without PGE no entry is marked global
+ * e.g.:
+ * Paging paging(&frames);
+ * paging.Activate();
+ */
+Paging::Paging(PhysicalFrameAllocator* frames) {
+  activePaging = this;
+  this->frames = frames;
+
+  uint32_t eax, ebx, ecx, edx;
+  asm volatile("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(1));
+  hasPSE = edx & (1 << 3);
+  hasPGE = edx & (1 << 13);
+  uint32_t global = hasPGE ? PAGE_GLOBAL : 0;
+
+  // NOTE: paging is still off here, so physical frames can be written through their address directly
+  pageDirectory = (uint32_t*)frames->AllocFrame();
+  for (uint32_t i = 0; i < 1024; i++) pageDirectory[i] = 0;
+
+  // first 4 MiB: page table with 4 KiB pages, page 0 stays unmapped (null pointer guard)
+  uint32_t* lowTable = GetPageTable(0, true);
+  for (uint32_t i = 1; i < 1024; i++)
+    lowTable[i] = (i * PAGE_SIZE) | global | PAGE_WRITABLE | PAGE_PRESENT;
+
+  // everything above: one PSE 4 MiB page per directory entry
+  if (hasPSE) {
+    for (uint32_t i = 1; i < 1024; i++)
+      pageDirectory[i] = (i * LARGE_PAGE_SIZE) | global | PAGE_LARGE | PAGE_WRITABLE | PAGE_PRESENT;
+    return;
+  }
+
+  // NOTE: a directory entry whose table cannot be allocated stays unmapped, accesses there fault
+  for (uint32_t i = 1; i < 1024; i++) {
+    uint32_t* table = GetPageTable(i * LARGE_PAGE_SIZE, true);
+    if (table == 0) break;
+    for (uint32_t j = 0; j < 1024; j++)
+      table[j] = (i * LARGE_PAGE_SIZE + j * PAGE_SIZE) | global | PAGE_WRITABLE | PAGE_PRESENT;
+  }
+}
+
+
+Paging::~Paging() {
+  if (activePaging == this) activePaging = 0;
+}
+
+
+void Paging::Activate() {
+  uint32_t cr4;
+  asm volatile("mov %%cr4, %0" : "=r"(cr4));
+  if (hasPSE) cr4 |= (1 << 4);  // PSE (4 MiB pages)
+  if (hasPGE) cr4 |= (1 << 7);  // PGE (global pages)
+  asm volatile("mov %0, %%cr4" : : "r"(cr4));
+
+  asm volatile("mov %0, %%cr3" : : "r"(pageDirectory) : "memory");
+
+  uint32_t cr0;
+  asm volatile("mov %%cr0, %0" : "=r"(cr0));
+  cr0 |= (1u << 31) | (1 << 16);  // PG (paging), WP (read-only pages apply to the kernel too)
+  asm volatile("mov %0, %%cr0" : : "r"(cr0) : "memory");
+}
+
+
+void Paging::InvalidatePage(uint32_t virtualAddress) {
+  asm volatile("invlpg (%0)" : : "r"(virtualAddress) : "memory");
+}
+
+
+/**
+ * [returns the page table covering virtualAddress]
+ * with create, a missing table is allocated and a 4 MiB large page is split into 1024 4 KiB pages
+ * (same physical memory and flags) so single pages inside it can be changed
+ */
+uint32_t* Paging::GetPageTable(uint32_t virtualAddress, bool create) {
+  uint32_t& entry = pageDirectory[virtualAddress >> 22];
+
+  if ((entry & PAGE_PRESENT) && !(entry & PAGE_LARGE)) return (uint32_t*)(entry & ~0xFFF);
+  if (!create) return 0;
+
+  uint32_t* table = (uint32_t*)frames->AllocFrame();
+  if (table == 0) return 0;
+
+  if (entry & PAGE_LARGE) {
+    uint32_t flags = entry & (PAGE_GLOBAL | PAGE_USER | PAGE_WRITABLE | PAGE_CACHE_DISABLE | PAGE_PRESENT);
+    uint32_t base = entry & ~(LARGE_PAGE_SIZE - 1);
+    for (uint32_t i = 0; i < 1024; i++) table[i] = (base + i * PAGE_SIZE) | flags;
+  } else {
+    for (uint32_t i = 0; i < 1024; i++) table[i] = 0;
+  }
+
+  // NOTE: the directory entry stays permissive, access rights are decided per page in the table
+  entry = (uint32_t)table | PAGE_USER | PAGE_WRITABLE | PAGE_PRESENT;
+  InvalidatePage(virtualAddress & ~(LARGE_PAGE_SIZE - 1));
+  return table;
+}
+
+
+bool Paging::MapPage(uint32_t virtualAddress, uint32_t physicalAddress, uint32_t flags) {
+  uint32_t* table = GetPageTable(virtualAddress, true);
+  if (table == 0) return false;
+
+  if (!hasPGE) flags &= ~PAGE_GLOBAL;
+  table[(virtualAddress >> 12) & 0x3FF] = (physicalAddress & ~0xFFF) | (flags & 0xFFF) | PAGE_PRESENT;
+  InvalidatePage(virtualAddress);
+  return true;
+}
+
+
+void Paging::UnmapPage(uint32_t virtualAddress) {
+  uint32_t* table = GetPageTable(virtualAddress, true);
+  if (table == 0) return;
+
+  table[(virtualAddress >> 12) & 0x3FF] = 0;
+  InvalidatePage(virtualAddress);
+}
+
+
+uint32_t Paging::GetPhysicalAddress(uint32_t virtualAddress) {
+  uint32_t entry = pageDirectory[virtualAddress >> 22];
+  if (!(entry & PAGE_PRESENT)) return 0;
+  if (entry & PAGE_LARGE) return (entry & ~(LARGE_PAGE_SIZE - 1)) | (virtualAddress & (LARGE_PAGE_SIZE - 1));
+
+  uint32_t page = ((uint32_t*)(entry & ~0xFFF))[(virtualAddress >> 12) & 0x3FF];
+  if (!(page & PAGE_PRESENT)) return 0;
+  return (page & ~0xFFF) | (virtualAddress & 0xFFF);
+}
+
+
+PageFaultHandler::PageFaultHandler(InterruptManager* interruptManager)
+    : InterruptHandler(interruptManager, 0x0E) {}
+
+
+PageFaultHandler::~PageFaultHandler() {}
+
+
+uint32_t PageFaultHandler::HandleInterrupt(uint32_t esp) {
+  CPUState* cpu = (CPUState*)esp;  // NOTE: for 0x0E the CPU pushes an error code, it lands in cpu->error
+
+  uint32_t faultAddress;
+  asm volatile("mov %%cr2, %0" : "=r"(faultAddress));
+
+  printf(RED_COLOR, BLACK_COLOR, "PAGE FAULT at 0x%x (eip 0x%x): ", faultAddress, cpu->eip);
+  printf(RED_COLOR, BLACK_COLOR, (cpu->error & 0x1) ? "protection violation, " : "page not present, ");
+  printf(RED_COLOR, BLACK_COLOR, (cpu->error & 0x2) ? "write, " : "read, ");
+  printf(RED_COLOR, BLACK_COLOR, (cpu->error & 0x4) ? "user mode" : "kernel mode");
+  if (cpu->error & 0x10) printf(RED_COLOR, BLACK_COLOR, ", instruction fetch");
+  if (faultAddress < Paging::PAGE_SIZE) printf(RED_COLOR, BLACK_COLOR, " (null pointer)");
+  printf("\n");
+
+  // NOTE: fatal by design, every mapping exists from boot and nothing is paged in lazily
+  while (true) asm volatile("cli; hlt");
+
+  return esp;
+}
@@ -0,0 +1,151 @@
+#include <memory/slab.h>
+
+using namespace os;
+using namespace os::common;
+using namespace os::memory;
+
+SlabCache* SlabCache::firstCache = 0;
+
+
+SlabCache::SlabCache(const char* name, size_t objectSize, size_t alignment, uint32_t objectsPerSlab) {
+  this->name = name;
+  this->objectSize = objectSize;
+
+  // NOTE: the alignment must be a power of two and large enough to hold the free list link
+  size_t powerOfTwo = sizeof(FreeObject*);
+  while (powerOfTwo < alignment) powerOfTwo <<= 1;
+  this->alignment = powerOfTwo;
+
+  size_t slotSize = objectSize < sizeof(FreeObject) ? sizeof(FreeObject) : objectSize;
+  stride = (slotSize + this->alignment - 1) & ~(this->alignment - 1);
+  this->objectsPerSlab = objectsPerSlab == 0 ? 1 : objectsPerSlab;
+
+  slabs = 0;
+  freeList = 0;
+
+  stats.objectSize = stride;
+  stats.slabs = 0;
+  stats.totalObjects = 0;
+  stats.activeObjects = 0;
+  stats.allocations = 0;
+  stats.frees = 0;
+  stats.failures = 0;
+
+  // register the cache so it shows up in the heap statistics
+  nextCache = firstCache;
+  firstCache = this;
+}
+
+
+SlabCache::~SlabCache() {
+  // unregister
+  if (firstCache == this) {
+    firstCache = nextCache;
+  } else {
+    for (SlabCache* cache = firstCache; cache != 0; cache = cache->nextCache) {
+      if (cache->nextCache == this) {
+        cache->nextCache = nextCache;
+        break;
+      }
+    }
+  }
+
+  // NOTE: every object of the cache dies with it, slabs go back to the heap
+  while (slabs != 0) {
+    Slab* next = slabs->next;
+    MemoryManager::activeMemoryManager->free(slabs);
+    slabs = next;
+  }
+}
+
+
+/**
+ * [takes one slab from the heap and threads all of its object slots onto the free list]
+ * NOTE: the heap lock is taken inside the cache lock, never the other way round
+ * DIAGRAM:
+ *   slab := [| Slab header | padding to alignment | object 0 | object 1 | ... | object n-1 |]
+ */
+bool SlabCache::Grow() {
+  if (MemoryManager::activeMemoryManager == 0) return false;
+
+  size_t slabSize = sizeof(Slab) + (alignment - 1) + stride * objectsPerSlab;
+  Slab* slab = (Slab*)MemoryManager::activeMemoryManager->malloc(slabSize);
+  if (slab == 0) return false;
+
+  slab->next = slabs;
+  slabs = slab;
+
+  uint32_t objects = ((uint32_t)slab + sizeof(Slab) + alignment - 1) & ~(alignment - 1);
+  for (uint32_t i = 0; i < objectsPerSlab; i++) {
+    FreeObject* object = (FreeObject*)(objects + i * stride);
+    object->next = freeList;
+    freeList = object;
+  }
+
+  stats.slabs++;
+  stats.totalObjects += objectsPerSlab;
+  return true;
+}
+
+
+/**
+ * [O(1) pops an object slot off the free list, grows the cache by one slab when empty]
+ * returns 0 if the heap is exhausted
+ */
+void* SlabCache::Alloc() {
+  uint32_t eflags = lock.Lock();
+  if (freeList == 0 && !Grow()) {
+    stats.failures++;
+    lock.Unlock(eflags);
+    return 0;
+  }
+
+  FreeObject* object = freeList;
+  freeList = object->next;
+
+  stats.activeObjects++;
+  stats.allocations++;
+  lock.Unlock(eflags);
+  return (void*)object;
+}
+
+
+/**
+ * [O(1) pushes an object slot back onto the free list]
+ * NOTE: ptr must have been returned by Alloc() of this same cache
+ */
+void SlabCache::Free(void* ptr) {
+  if (ptr == 0) return;
+
+  FreeObject* object = (FreeObject*)ptr;
+  uint32_t eflags = lock.Lock();
+  object->next = freeList;
+  freeList = object;
+
+  stats.activeObjects--;
+  stats.frees++;
+  lock.Unlock(eflags);
+}
+
+
+const char* SlabCache::GetName() {
+  return name;
+}
+
+
+SlabCacheStats SlabCache::GetStats() {
+  uint32_t eflags = lock.Lock();
+  SlabCacheStats copy = stats;
+  lock.Unlock(eflags);
+  return copy;
+}
+
+
+SlabCache* SlabCache::First() {
+  return firstCache;
+}
+
+
+SlabCache* SlabCache::Next() {
+  return nextCache;
+}
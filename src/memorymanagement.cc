@@ -1,3 +1,5 @@
+#include <memory/frameallocator.h>
+#include <memory/heaptrace.h>
 #include <memorymanagement.h>
 
 #include <cwchar>
@@ -8,95 +10,291 @@ using namespace os::common;
 MemoryManager* MemoryManager::activeMemoryManager = 0;  // initally, activeMemoryManager is 0
 
 
+/**
+ * [bit scan helpers, "bsr"/"bsf" find the highest/lowest set bit in a single instruction]
+ * NOTE: the result is undefined for value == 0, callers must check first
+ */
+static inline uint32_t BitScanReverse(uint32_t value) {
+  uint32_t index;
+  asm("bsr %1, %0" : "=r"(index) : "rm"(value));
+  return index;
+}
+
+static inline uint32_t BitScanForward(uint32_t value) {
+  uint32_t index;
+  asm("bsf %1, %0" : "=r"(index) : "rm"(value));
+  return index;
+}
+
+
 MemoryManager::MemoryManager(size_t start, size_t size) {
   activeMemoryManager = this;  // set the activeMemoryManager to "this" MemoryManager
 
-  if (size < sizeof(MemoryChunk)) {
-    first = 0;
-  } else {
-    first = (MemoryChunk*)start;
+  for (uint32_t i = 0; i < NUM_BINS; i++) {
+    bins[i] = 0;
+    freeChunksInBin[i] = 0;
+    allocatedChunksInBin[i] = 0;
+  }
+  binBitmap = 0;
+  stats = HeapStats();  // NOTE: value-initialization, every counter starts at 0
+  largestFreeStale = false;
+  first = 0;
+  last = 0;
+  frames = 0;
+
+  AddRegion(start, size);
+}
+
 
-    first->allocated = false;
-    first->next = 0;
-    first->prev = 0;
-    first->size = size - sizeof(MemoryChunk);  // NOTE: sizeof(MemoryChunk) := metadata + size_t size
+/**
+ * [heap without a fixed region, pages are taken from the frame allocator on demand]
+ * e.g.:
+ * PhysicalFrameAllocator frames(multiboot_structure);
+ * MemoryManager heap(&frames, 1024 * 1024);
+ */
+MemoryManager::MemoryManager(memory::PhysicalFrameAllocator* frames, size_t initialSize) {
+  activeMemoryManager = this;
+
+  for (uint32_t i = 0; i < NUM_BINS; i++) {
+    bins[i] = 0;
+    freeChunksInBin[i] = 0;
+    allocatedChunksInBin[i] = 0;
   }
+  binBitmap = 0;
+  stats = HeapStats();  // NOTE: value-initialization, every counter starts at 0
+  largestFreeStale = false;
+  first = 0;
+  last = 0;
+  this->frames = frames;
+
+  if (initialSize > 0) Grow(initialSize);
 }
 
 
 MemoryManager::~MemoryManager() {}
 
 
-void* MemoryManager::malloc(size_t size) {
-  MemoryChunk* result = 0;
+/**
+ * [O(1) size-class lookup, bin i holds chunks with size in [2^i, 2^(i+1))]
+ */
+uint32_t MemoryManager::BinIndex(size_t size) {
+  return BitScanReverse(size);
+}
+
+
+/**
+ * [O(1) push a free chunk onto the head of its size-class bin]
+ */
+void MemoryManager::InsertIntoBin(MemoryChunk* chunk) {
+  uint32_t index = BinIndex(chunk->size);
+  chunk->prevFree = 0;
+  chunk->nextFree = bins[index];
+  if (bins[index] != 0) bins[index]->prevFree = chunk;
+  bins[index] = chunk;
+  binBitmap |= (1u << index);
+
+  freeChunksInBin[index]++;
+  stats.freeChunks++;
+  stats.bytesFree += chunk->size;
+  if (chunk->size > stats.largestFreeBlock) stats.largestFreeBlock = chunk->size;
+}
+
+
+/**
+ * [O(1) unlink a free chunk from its size-class bin]
+ */
+void MemoryManager::RemoveFromBin(MemoryChunk* chunk) {
+  uint32_t index = BinIndex(chunk->size);
+  if (chunk->prevFree != 0)
+    chunk->prevFree->nextFree = chunk->nextFree;
+  else
+    bins[index] = chunk->nextFree;
+  if (chunk->nextFree != 0) chunk->nextFree->prevFree = chunk->prevFree;
+  if (bins[index] == 0) binBitmap &= ~(1u << index);
+  chunk->nextFree = 0;
+  chunk->prevFree = 0;
+
+  freeChunksInBin[index]--;
+  stats.freeChunks--;
+  stats.bytesFree -= chunk->size;
+  if (chunk->size == stats.largestFreeBlock) largestFreeStale = true;
+}
+
+
+/**
+ * [true if next starts right where chunk's payload ends, only those chunks may be merged]
+ * NOTE: regions added by Grow() are linked into the same chunk list but need not be contiguous
+ */
+bool MemoryManager::Adjacent(MemoryChunk* chunk, MemoryChunk* next) {
+  return (size_t)chunk + sizeof(MemoryChunk) + chunk->size == (size_t)next;
+}
+
+
+/**
+ * [links a new memory region into the heap as one free chunk]
+ * if the region starts right after the last chunk and that chunk is free, it is simply extended
+ */
+void MemoryManager::AddRegion(size_t start, size_t size) {
+  // NOTE: align the region start so every chunk (and therefore every payload) is ALIGNMENT aligned
+  size_t alignedStart = (start + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+  if (size < alignedStart - start)
+    size = 0;
+  else
+    size -= alignedStart - start;
+  size &= ~(ALIGNMENT - 1);
+
+  stats.heapSize += size;
+  stats.regions++;
+
+  if (last != 0 && !last->allocated && Adjacent(last, (MemoryChunk*)alignedStart)) {
+    RemoveFromBin(last);
+    last->size += size;
+    InsertIntoBin(last);
+    return;
+  }
+
+  if (size < sizeof(MemoryChunk) + MIN_SPLIT_PAYLOAD) return;
+
+  MemoryChunk* chunk = (MemoryChunk*)alignedStart;
+  chunk->allocated = false;
+  chunk->size = size - sizeof(MemoryChunk);  // NOTE: sizeof(MemoryChunk) := metadata + size_t size
+  chunk->next = 0;
+  chunk->prev = last;
+  if (last != 0)
+    last->next = chunk;
+  else
+    first = chunk;
+  last = chunk;
+
+  InsertIntoBin(chunk);
+}
+
+
+/**
+ * [takes enough contiguous pages from the frame allocator to serve a request of size bytes]
+ */
+bool MemoryManager::Grow(size_t size) {
+  if (frames == 0) return false;
+
+  uint32_t pageSize = memory::PhysicalFrameAllocator::FRAME_SIZE;
+  uint32_t pages = (size + sizeof(MemoryChunk) + pageSize - 1) / pageSize;
+  if (pages < GROW_MIN_PAGES) pages = GROW_MIN_PAGES;
+
+  uint32_t region = frames->AllocFrames(pages);
+  if (region == 0) {
+    // NOTE: memory may be too fragmented for the preferred growth size, retry with the minimum
+    pages = (size + sizeof(MemoryChunk) + pageSize - 1) / pageSize;
+    region = frames->AllocFrames(pages);
+    if (region == 0) return false;
+  }
+
+  AddRegion(region, pages * pageSize);
+  return true;
+}
+
 
-  // iterate through the memory space and find unallocated space large enough for requested size
-  // NOTE: pretty much iterating through a linked list
-  for (MemoryChunk* chunk = first; chunk != 0 && result == 0;
-       chunk = chunk->next) {  // FIXME: O(n) complexity to find unallocated space
-    if (size <= chunk->size && !chunk->allocated) result = chunk;
+/**
+ * [returns a free chunk with at least size bytes of payload, or 0 if the heap has none]
+ */
+MemoryChunk* MemoryManager::FindFreeChunk(size_t size) {
+  MemoryChunk* result = 0;
+  uint32_t index = BinIndex(size);
+
+  /* NOTE: segregated fit, the search is O(1) in the common case:
+   * 1. the head of the request's own bin is checked first (reuses recently freed chunks of this size)
+   * 2. any chunk in a bin above the request's bin is guaranteed to be large enough, so the bitmap of
+   *    non-empty bins + one bit scan picks the smallest such bin
+   * 3. only if both fail, the request's own bin is walked first-fit (chunks there may be too small)
+   */
+  if (bins[index] != 0 && bins[index]->size >= size) {
+    result = bins[index];
+  } else {
+    uint32_t largerBins = (index + 1 < NUM_BINS) ? binBitmap & ~((2u << index) - 1) : 0;
+    if (largerBins != 0) {
+      result = bins[BitScanForward(largerBins)];
+    } else {
+      for (MemoryChunk* chunk = bins[index]; chunk != 0 && result == 0; chunk = chunk->nextFree)
+        if (chunk->size >= size) result = chunk;
+    }
   }
+  return result;
+}
+
+
+void* MemoryManager::malloc(size_t size) {
+  if (size == 0) size = 1;
+  if (size > 0xFFFFFFFF - ALIGNMENT) return 0;
+  size = (size + ALIGNMENT - 1) & ~(ALIGNMENT - 1);  // round up so the next chunk stays aligned
+
+  uint32_t eflags = lock.Lock();
+  MemoryChunk* result = FindFreeChunk(size);
+  if (result == 0 && Grow(size)) result = FindFreeChunk(size);
 
   if (result == 0) {  // at this point, there is no available space to be allocated for requested size
+    stats.failures++;
+    lock.Unlock(eflags);
     return 0;
   }
 
+  RemoveFromBin(result);
+
   // NOTE: available space needs to be (requested size + metadata) since requested size does not account
-  // for metadata of MemoryChunk NOTE: "+ 1" acts like a buffer between requested size and the next
-  // MemoryChunk*; without the "+ 1", the requested size would be directly followed by the metadata for
-  // the next MemoryChunk*
+  // for metadata of MemoryChunk. the remaining chunk must be able to hold its own metadata plus a
+  // minimal payload (MIN_SPLIT_PAYLOAD), otherwise the leftover bytes simply stay attached to the result
+  // chunk; this replaces the old "+ 1" buffer between the requested size and the next MemoryChunk*
 
   // if the result chunk is more than what we need, then we can partition it into what we need
   // the result will be partitioned into [ (metadata + requested size) | remaining result chunk ]
-  if (result->size >=
-      size + sizeof(MemoryChunk) + 1) {  // the result MemoryChunk size is more than the (metadata +
-                                         // requested size), so we can partition
-    MemoryChunk* remaining = (MemoryChunk*)((size_t)result + sizeof(MemoryChunk) +
-                                            size);  // turn the  remaining unallocated space into
-                                                    // MemoryChunk (metadata + size)
+  if (result->size >= size + sizeof(MemoryChunk) + MIN_SPLIT_PAYLOAD) {
+    MemoryChunk* remaining = (MemoryChunk*)((size_t)result + sizeof(MemoryChunk) + size);
     remaining->allocated = false;
-    remaining->size =
-        result->size -
-        (size +
-         sizeof(MemoryChunk));  // remaining size = result_chunk size - (metadata + requested size)
+    remaining->size = result->size - (size + sizeof(MemoryChunk));
     remaining->prev = result;
     remaining->next = result->next;
     if (remaining->next != 0) remaining->next->prev = remaining;
 
-
     result->size = size;
     result->next = remaining;
+    if (last == result) last = remaining;
+
+    InsertIntoBin(remaining);  // the leftover space goes back into the bin for its size
     /*
       DIAGRAM: Partitioning of result_chunk if result_chunk size is more than the (metadata + requested
       size)
 
-      (time=0) | MEMORYDIMENSION := {[chunk1], [chunk2], [ ... unallocated space (64 KB) ... ], [chunk3],
-      [chunk4], [
-      ... unallocated space (16 KB) ...  ] } => entire memory space
-
-      (time=1) | malloc(size_t: 256) => requested size := 8192 bytes (size_t == uint32_t, so 32 * 32 =
-      8192) (time=1) | let metadata be 512 bytes => (metadata + requested size) = 512 + 8192 = 8704
-      (total size needed) (time=1) | result_chunk := first unallocated sector in memory space greater
-      than requested size (8192 bytes), see for loop above for more details (time=1) | result_chunk->size
-      = 65536 bytes ( the result_chunk->size == unallocated space)
-
-      (time=2) | the result_chunk->size is greater than (metadata + requested size = 8702), so partition
-      the result_chunk (unallocated space) , at this point, the unallocated has no metadata (time=2) |
-      turn the result_chunk (unallocated space) into a MemoryChunk (result_chunk->size + metadata)
-      (time=2) | result_chunk := [ (metadata + requested size) | remaining_after_partitioning |] (time=2)
-      | initalize metadata values (next, prev, allocated, size) for remaining_chunk,(e.g.
-      remaining_chunk->size = result_chunk->size - (metadata + requested size)) (time=2) | result_chunk
-      := [ (metadata + requested size)], unallocated_space := [ remaining_after_partitioning] (time=2) |
-      now, the result_chunk->size = (metadata + requested size), so we are good to return the
-      result_chunk, the remaining_chunk just becomes unallocated space again
-
-      (time=3) | MEMORYDIMENSION := {[chunk1], [chunk2], [chunk5], [ ... unallocated space (55.5 KB) ...
-      ], [chunk3], [chunk4], [ ... unallocated space (16 KB) ... ] } => entire memory space
-
-  */
+      (time=0) | MEMORYDIMENSION := {[chunk1], [chunk2], [ ... free (64 KB) ... ], [chunk3], [chunk4],
+                 [ ... free (16 KB) ... ] } => entire memory space, linked in address order by next/prev
+      (time=0) | bins[16] := { free (64 KB) }, bins[14] := { free (16 KB) } => the same free chunks,
+                 linked by size class through nextFree/prevFree
+
+      (time=1) | malloc(size_t: 8190) => rounded up to ALIGNMENT, requested size := 8192 bytes
+      (time=1) | metadata := sizeof(MemoryChunk) = 24 bytes => (metadata + requested size) = 8216 bytes
+      (time=1) | FindFreeChunk(8192): bins[13] := [8 KB, 16 KB) is empty, the bitmap has bits 14 and 16
+                 set above it, the bit scan picks bins[14] => result_chunk := free (16 KB), no list walk
+      (time=1) | RemoveFromBin(result_chunk), result_chunk->size = 16384 bytes
+
+      (time=2) | result_chunk->size >= (metadata + requested size + MIN_SPLIT_PAYLOAD), so partition it
+      (time=2) | result_chunk := [ (metadata + requested size) | remaining_chunk ]
+      (time=2) | initialize metadata values (next, prev, allocated, size) for remaining_chunk, (e.g.
+                 remaining_chunk->size = result_chunk->size - (metadata + requested size) = 8168 bytes)
+      (time=2) | result_chunk->size = requested size, result_chunk->next = remaining_chunk
+      (time=2) | InsertIntoBin(remaining_chunk) => bins[12] := { remaining_chunk (8168 bytes) }
+
+      (time=3) | MEMORYDIMENSION := {[chunk1], [chunk2], [ ... free (64 KB) ... ], [chunk3], [chunk4],
+                 [chunk5], [ ... free (7.98 KB) ... ] } => entire memory space
+      (time=3) | bins[16] := { free (64 KB) }, bins[12] := { free (7.98 KB) }, bins[14] := { }
+    */
   }
   result->allocated = true;
 
+  allocatedChunksInBin[BinIndex(result->size)]++;
+  stats.allocations++;
+  stats.allocatedChunks++;
+  stats.bytesAllocated += result->size;
+  if (stats.bytesAllocated > stats.peakBytesAllocated) stats.peakBytesAllocated = stats.bytesAllocated;
+  if (stats.allocatedChunks > stats.peakAllocatedChunks) stats.peakAllocatedChunks = stats.allocatedChunks;
+  lock.Unlock(eflags);
+
   return (void*)(sizeof(MemoryChunk) +
                  ((size_t)result));  // return a pointer to the chunk (MemoryChunk*) that is
                                      // available to be allocated towards the requested size
@@ -108,23 +306,96 @@ void MemoryManager::free(void* ptr) {
 
   MemoryChunk* chunk = (MemoryChunk*)((size_t)ptr - sizeof(MemoryChunk));
 
+  uint32_t eflags = lock.Lock();
   chunk->allocated = false;
 
-  if (chunk->prev != 0 && !chunk->prev->allocated) {
+  allocatedChunksInBin[BinIndex(chunk->size)]--;
+  stats.frees++;
+  stats.allocatedChunks--;
+  stats.bytesAllocated -= chunk->size;
+
+  // NOTE: boundary-tag coalescing, the physical prev/next links find both neighbours in O(1)
+  /*
+    DIAGRAM: free(chunk2) with a free neighbour on both sides
+
+    (time=0) | MEMORYDIMENSION := {[chunk1 (free)], [chunk2], [chunk3 (free)], [chunk4] }
+    (time=1) | chunk1 is free and Adjacent(chunk1, chunk2) => RemoveFromBin(chunk1), chunk1 absorbs
+               chunk2 (chunk1->size += metadata + chunk2->size)
+    (time=2) | chunk3 is free and Adjacent(chunk1, chunk3) => RemoveFromBin(chunk3), chunk1 absorbs
+               chunk3 (chunk1->size += metadata + chunk3->size)
+    (time=3) | InsertIntoBin(chunk1) => MEMORYDIMENSION := {[chunk1 (free)], [chunk4] }, chunk1 now sits
+               in the bin of its new, larger size
+
+    NOTE: chunks of two regions added by Grow() are never merged, there may be a gap between them
+  */
+  if (chunk->prev != 0 && !chunk->prev->allocated && Adjacent(chunk->prev, chunk)) {
+    RemoveFromBin(chunk->prev);
     chunk->prev->next = chunk->next;
     chunk->prev->size += chunk->size + sizeof(MemoryChunk);
 
     if (chunk->next != 0) chunk->next->prev = chunk->prev;
+    if (last == chunk) last = chunk->prev;
 
     chunk = chunk->prev;
   }
 
-  if (chunk->next != 0 && !chunk->next->allocated) {
+  if (chunk->next != 0 && !chunk->next->allocated && Adjacent(chunk, chunk->next)) {
+    RemoveFromBin(chunk->next);
+    if (last == chunk->next) last = chunk;
     chunk->size += chunk->next->size + sizeof(MemoryChunk);
     chunk->next = chunk->next->next;
     if (chunk->next != 0)  // if the new next chunk exists, then set its previous pointer to ourselves
       chunk->next->prev = chunk;
   }
+
+  InsertIntoBin(chunk);
+  lock.Unlock(eflags);
+}
+
+
+/**
+ * [snapshot of the heap counters]
+ * O(1) except after the largest free chunk was taken, then only the highest non-empty bin is walked
+ * (every chunk in a lower bin is smaller than any chunk in it)
+ */
+HeapStats MemoryManager::GetStats() {
+  uint32_t eflags = lock.Lock();
+  if (largestFreeStale) {
+    stats.largestFreeBlock = 0;
+    if (binBitmap != 0)
+      for (MemoryChunk* chunk = bins[BitScanReverse(binBitmap)]; chunk != 0; chunk = chunk->nextFree)
+        if (chunk->size > stats.largestFreeBlock) stats.largestFreeBlock = chunk->size;
+    largestFreeStale = false;
+  }
+
+  // NOTE: external fragmentation := 1 - largest / free, both are scaled down first so that
+  // largest * 100 fits into 32 bits (no 64-bit division without libgcc)
+  size_t largest = stats.largestFreeBlock;
+  size_t free = stats.bytesFree;
+  while (free > 0x1000000) {
+    largest >>= 1;
+    free >>= 1;
+  }
+  stats.fragmentation = (free == 0) ? 0 : 100 - (largest * 100) / free;
+
+  HeapStats snapshot = stats;
+  lock.Unlock(eflags);
+  return snapshot;
+}
+
+
+uint32_t MemoryManager::GetFreeChunksInBin(uint32_t bin) {
+  return (bin < NUM_BINS) ? freeChunksInBin[bin] : 0;
+}
+
+
+uint32_t MemoryManager::GetAllocatedChunksInBin(uint32_t bin) {
+  return (bin < NUM_BINS) ? allocatedChunksInBin[bin] : 0;
+}
+
+
+LockStats MemoryManager::GetLockStats() {
+  return lock.GetStats();
 }
 
 
@@ -136,7 +407,13 @@ void MemoryManager::free(void* ptr) {
  */
 void* operator new(unsigned size) {
   if (os::MemoryManager::activeMemoryManager == 0) return 0;
+#ifdef HEAP_TRACE
+  void* ptr = os::MemoryManager::activeMemoryManager->malloc(size);
+  os::memory::HeapTrace::Record(ptr, size, __builtin_return_address(0));
+  return ptr;
+#else
   return os::MemoryManager::activeMemoryManager->malloc(size);
+#endif
 }
 /**
  * [allocate memory for array of objects on DracOS heap]
@@ -147,7 +424,13 @@ void* operator new(unsigned size) {
  */
 void* operator new[](unsigned size) {
   if (os::MemoryManager::activeMemoryManager == 0) return 0;
+#ifdef HEAP_TRACE
+  void* ptr = os::MemoryManager::activeMemoryManager->malloc(size);
+  os::memory::HeapTrace::Record(ptr, size, __builtin_return_address(0));
+  return ptr;
+#else
   return os::MemoryManager::activeMemoryManager->malloc(size);
+#endif
 }
 
 void* operator new(unsigned size, void* ptr) {
@@ -163,6 +446,9 @@ void* operator new[](unsigned size, void* ptr) {
  */
 void operator delete(void* ptr) {
   if (os::MemoryManager::activeMemoryManager != 0) {
+#ifdef HEAP_TRACE
+    os::memory::HeapTrace::Forget(ptr);
+#endif
     os::MemoryManager::activeMemoryManager->free(ptr);
   }
 }
@@ -171,17 +457,26 @@ void operator delete(void* ptr) {
  */
 void operator delete[](void* ptr) {
   if (os::MemoryManager::activeMemoryManager != 0) {
+#ifdef HEAP_TRACE
+    os::memory::HeapTrace::Forget(ptr);
+#endif
     os::MemoryManager::activeMemoryManager->free(ptr);
   }
 }
 
 void operator delete(void* ptr, unsigned size) {
   if (os::MemoryManager::activeMemoryManager != 0) {
+#ifdef HEAP_TRACE
+    os::memory::HeapTrace::Forget(ptr);
+#endif
     os::MemoryManager::activeMemoryManager->free(ptr);
   }
 }
 void operator delete[](void* ptr, unsigned size) {
   if (os::MemoryManager::activeMemoryManager != 0) {
+#ifdef HEAP_TRACE
+    os::memory::HeapTrace::Forget(ptr);
+#endif
     os::MemoryManager::activeMemoryManager->free(ptr);
   }
 }
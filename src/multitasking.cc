@@ -1,13 +1,57 @@
+#include <fpu.h>
+#include <hardwarecommunication/interrupts.h>
 #include <multitasking.h>
+#include <smp.h>
 
 using namespace os;
 using namespace os::common;
 using namespace os::utils;
+using namespace os::hardwarecommunication;
 
 
 Task::Task(GlobalDescriptorTable* gdt, void entrypoint()) {
-  cpustate =
-      (CPUState*)(stack + 4096 - sizeof(CPUState));  // NOTE: (start of stack) + (size of stack) - (size of entrypoint)
+  thread = false;
+  Init(gdt, (uint32_t)entrypoint);
+}
+
+
+/**
+ * [kernel thread, runs entrypoint(argument) and exits when it returns]
+ * e.g.:
+ * Task* worker = taskManager.CreateThread(WorkerMain, queue);
+ * taskManager.Join(worker);
+ */
+Task::Task(GlobalDescriptorTable* gdt, void (*entrypoint)(void*), void* argument) {
+  thread = true;
+  Init(gdt, (uint32_t)entrypoint);
+
+  /* NOTE: a ring 0 iret does not pop esp/ss, the thread starts with esp pointing at them.
+   * so they become the frame of a call: return address, then the argument.
+   *
+   * DIAGRAM:
+   *   [| ... stack | eax ... eflags | esp := &TaskManager::Exit | ss := argument |]
+   *                                  ^ esp after iret
+   */
+  cpustate->esp = (uint32_t)&TaskManager::Exit;
+  cpustate->ss = (uint32_t)argument;
+}
+
+
+void Task::Init(GlobalDescriptorTable* gdt, uint32_t entrypoint) {
+  state = TaskState::Runnable;
+  priority = PRIORITY_NORMAL;
+  timeSlice = TaskManager::TIME_SLICE;
+  runTicks = 0;
+  next = 0;
+  wakeTick = 0;
+  joiner = 0;
+  cpu = 0;
+  running = false;
+  wakePending = false;
+  fpuUsed = false;
+  fpuCPU = CPU::MAX_CPUS;
+  // NOTE: (start of stack) + (size of stack) - (size of entrypoint)
+  cpustate = (CPUState*)(stack + STACK_SIZE - sizeof(CPUState));
 
 
   cpustate->eax = 0;
@@ -18,6 +62,7 @@ Task::Task(GlobalDescriptorTable* gdt, void entrypoint()) {
   cpustate->esi = 0;
   cpustate->edi = 0;
   cpustate->ebp = 0;
+  cpustate->interrupt = 0;
 
   /*
   cpustate -> gs = 0;
@@ -28,7 +73,7 @@ Task::Task(GlobalDescriptorTable* gdt, void entrypoint()) {
 
   cpustate->error = 0;
 
-  cpustate->eip = (uint32_t)entrypoint;
+  cpustate->eip = entrypoint;
   cpustate->cs = gdt->CodeSegmentSelector();
   cpustate->eflags = 0x202;  // HACK: magicnumbers for the win i guess lmao
   cpustate->esp = 0;  // NOTE: if it multitasking stops working, the problem is most likely within this struct. comment
@@ -38,11 +83,53 @@ Task::Task(GlobalDescriptorTable* gdt, void entrypoint()) {
 
 
 Task::~Task() {
+  FPU::Forget(this);
+}
+
+
+uint8_t* Task::FPUState() {
+  return (uint8_t*)(((uint32_t)fpuState + 15) & ~15);
+}
+
+
+TaskState Task::GetState() {
+  return state;
+}
+
+
+uint8_t Task::GetPriority() {
+  return priority;
 }
 
-TaskManager::TaskManager() {
+
+uint32_t Task::GetRunTicks() {
+  return runTicks;
+}
+
+
+TaskManager* TaskManager::activeTaskManager = 0;
+
+
+TaskManager::TaskManager(GlobalDescriptorTable* gdt) {
+  activeTaskManager = this;
+  this->gdt = gdt;
   numTasks = 0;
-  currentTask = -1;
+  for (uint32_t cpu = 0; cpu < CPU::MAX_CPUS; cpu++) {
+    RunQueue* runQueue = &runQueues[cpu];
+    for (uint8_t p = 0; p < Task::NUM_PRIORITIES; p++) {
+      runQueue->head[p] = 0;
+      runQueue->tail[p] = 0;
+    }
+    runQueue->readyBitmap = 0;
+    runQueue->count = 0;
+    runQueue->current = 0;
+    runQueue->switchedFrom = 0;
+    runQueue->idleState = 0;
+    runQueue->needReschedule = false;
+    runQueue->idleTicks = 0;
+  }
+  sleepQueue = 0;
+  ticks = 0;
 }
 
 
@@ -50,21 +137,210 @@ TaskManager::~TaskManager() {
 }
 
 
+/**
+ * [ticket lock over the scheduler state, shared by all CPUs]
+ * every CPU takes it on each tick, switch and wakeup, FIFO order keeps one CPU from starving the others.
+ * NOTE: interrupts must be disabled, an interrupt handler on the same CPU would spin on it forever.
+ * not an IrqSpinlock since every caller has saved the interrupt flag already
+ */
+void TaskManager::Lock() {
+  lock.Lock();
+}
+
+
+void TaskManager::Unlock() {
+  lock.Unlock();
+}
+
+
+LockStats TaskManager::GetLockStats() {
+  return lock.GetStats();
+}
+
+
+/**
+ * [appends a runnable task to a run queue, the lock must be held]
+ * it goes back to the CPU it last ran on, unless that one runs something at least as important and
+ * another CPU is idle
+ */
+void TaskManager::Enqueue(Task* task) {
+  uint32_t cpus = CPU::Count();
+  uint32_t cpu = task->cpu < cpus ? task->cpu : 0;
+  RunQueue* runQueue = &runQueues[cpu];
+
+  if (runQueue->current != 0 && runQueue->current->priority <= task->priority) {
+    for (uint32_t i = 0; i < cpus; i++) {
+      if (runQueues[i].current != 0 || runQueues[i].count != 0) continue;
+      cpu = i;
+      runQueue = &runQueues[i];
+      break;
+    }
+  }
+
+  uint8_t p = task->priority;
+  task->next = 0;
+  task->cpu = cpu;
+  if (runQueue->tail[p] != 0)
+    runQueue->tail[p]->next = task;
+  else
+    runQueue->head[p] = task;
+  runQueue->tail[p] = task;
+  runQueue->readyBitmap |= (1u << p);
+  runQueue->count++;
+
+  // NOTE: a more important task became runnable, preempt the current one at the end of this interrupt
+  if (runQueue->current == 0 || p < runQueue->current->priority) {
+    runQueue->needReschedule = true;
+    if (cpu != CPU::Current() && SMP::activeSMP != 0) SMP::activeSMP->SendReschedule(cpu);
+  }
+}
+
+
+/**
+ * [takes the next task for cpu off its run queue, the lock must be held]
+ * with nothing queued on cpu it steals the most important task queued on another CPU
+ */
+Task* TaskManager::Dequeue(uint32_t cpu) {
+  RunQueue* runQueue = &runQueues[cpu];
+
+  if (runQueue->readyBitmap == 0) {
+    uint32_t best = Task::NUM_PRIORITIES;
+    uint32_t cpus = CPU::Count();
+    for (uint32_t i = 0; i < cpus; i++) {
+      if (i == cpu || runQueues[i].readyBitmap == 0) continue;
+      uint32_t p;
+      asm("bsf %1, %0" : "=r"(p) : "rm"(runQueues[i].readyBitmap));
+      if (p >= best) continue;
+      best = p;
+      runQueue = &runQueues[i];
+    }
+    if (runQueue->readyBitmap == 0) return 0;
+  }
+
+  uint32_t p;
+  asm("bsf %1, %0" : "=r"(p) : "rm"(runQueue->readyBitmap));  // lowest set bit := highest priority
+
+  Task* task = runQueue->head[p];
+  runQueue->head[p] = task->next;
+  if (runQueue->head[p] == 0) {
+    runQueue->tail[p] = 0;
+    runQueue->readyBitmap &= ~(1u << p);
+  }
+  runQueue->count--;
+  task->next = 0;
+  return task;
+}
+
+
 bool TaskManager::AddTask(Task* task) {
-  if (numTasks >= 256) return false;
-  tasks[numTasks++] = task;
-  return true;
+  uint32_t eflags = SaveInterrupts();
+  Lock();
+  bool added = numTasks < 256;
+  if (added) {
+    tasks[numTasks++] = task;
+    if (task->state == TaskState::Runnable) Enqueue(task);
+  }
+  Unlock();
+  RestoreInterrupts(eflags);
+  return added;
+}
+
+
+/**
+ * [charges elapsed ticks to what the calling CPU runs, asks for a switch once the slice is over]
+ * NOTE: the lock must be held
+ */
+void TaskManager::Account(uint32_t elapsed) {
+  RunQueue* runQueue = &runQueues[CPU::Current()];
+  Task* current = runQueue->current;
+
+  if (current == 0) {
+    runQueue->idleTicks += elapsed;
+    // NOTE: an idle CPU looks at the other queues too, it may steal from them
+    uint32_t cpus = CPU::Count();
+    for (uint32_t i = 0; i < cpus; i++)
+      if (runQueues[i].count != 0) runQueue->needReschedule = true;
+    return;
+  }
+
+  current->runTicks += elapsed;
+  current->timeSlice = current->timeSlice > elapsed ? current->timeSlice - elapsed : 0;
+  if (current->timeSlice == 0) runQueue->needReschedule = true;
 }
 
 
+/**
+ * [kernel tick on the bootstrap processor: wakes the sleepers that are due and charges the tick]
+ */
+void TaskManager::Tick(uint32_t elapsed) {
+  Lock();
+  ticks += elapsed;
+
+  // NOTE: the queue is sorted, only the tasks that are due are touched. MakeRunnable() unlinks the head
+  // in O(1) and leaves a task alone that is still its CPU's current one (between Sleep()'s Unlock() and
+  // Yield() on an AP), Schedule() queues that one when it switches away
+  while (sleepQueue != 0 && (int32_t)(ticks - sleepQueue->wakeTick) >= 0) MakeRunnable(sleepQueue);
+
+  Account(elapsed);
+  Unlock();
+}
+
+
+/**
+ * [timer interrupt of an application processor, only the time slices]
+ */
+void TaskManager::TickLocal(uint32_t elapsed) {
+  Lock();
+  Account(elapsed);
+  Unlock();
+}
+
+
+bool TaskManager::NeedsReschedule() {
+  return runQueues[CPU::Current()].needReschedule;
+}
+
+
+/**
+ * [saves the interrupted context and picks the next one for the calling CPU]
+ * called by the InterruptManager on the way out of an interrupt once NeedsReschedule() is set
+ */
 CPUState* TaskManager::Schedule(CPUState* cpustate) {
   static int scheduleCount = 0;
-  // PERFORMANCE: round-robin scheduling algorithm
-  if (numTasks <= 0) return cpustate;
+  // PERFORMANCE: O(1), one bsf on the priority bitmap (one per CPU when stealing)
+
+  uint32_t cpu = CPU::Current();
+  RunQueue* runQueue = &runQueues[cpu];
+  Lock();
 
-  if (currentTask >= 0) tasks[currentTask]->cpustate = cpustate;
+  Task* previous = runQueue->current;
+  if (previous != 0) {
+    previous->cpustate = cpustate;
+    if (previous->state == TaskState::Runnable) {
+      // NOTE: a task whose slice ran out goes behind its equals, a preempted one keeps what is left
+      if (previous->timeSlice == 0) previous->timeSlice = TIME_SLICE;
+      Enqueue(previous);
+    }
+  } else {
+    runQueue->idleState = cpustate;
+  }
 
-  if (++currentTask >= numTasks) currentTask %= numTasks;
+  Task* next = Dequeue(cpu);
+  runQueue->needReschedule = false;  // NOTE: Enqueue() above may have set it again
+  runQueue->current = next;
+
+  if (next != previous) {
+    // NOTE: previous may only run elsewhere once this CPU is off its stack, see FinishSwitch()
+    runQueue->switchedFrom = previous;
+    if (next != 0) {
+      while (next->running) asm volatile("pause");  // its old CPU is still on the way out
+      next->running = true;
+    }
+  }
+  if (next != 0) next->cpu = cpu;
+  Unlock();
+
+  if (next != previous) FPU::SwitchFrom(previous);
 
   // TEST: prints the schedule count every 10 calls to the scheduling algorithm
   // scheduleCount++;
@@ -74,5 +350,312 @@ CPUState* TaskManager::Schedule(CPUState* cpustate) {
   //   printf("\n");
   // }
 
-  return tasks[currentTask]->cpustate;
+  return (next == 0) ? runQueue->idleState : next->cpustate;
+}
+
+
+/**
+ * [releases the task the calling CPU switched away from, its stack is no longer in use]
+ * NOTE: called by the interrupt stub on every way out, after esp points at the new context
+ */
+void TaskManager::FinishSwitch() {
+  TaskManager* taskManager = activeTaskManager;
+  if (taskManager == 0) return;
+
+  RunQueue* runQueue = &taskManager->runQueues[CPU::Current()];
+  Task* previous = runQueue->switchedFrom;
+  if (previous == 0) return;
+
+  runQueue->switchedFrom = 0;
+  asm volatile("" : : : "memory");
+  previous->running = false;
+}
+
+
+/**
+ * [allocates a kernel thread and makes it runnable, it starts once the scheduler picks it]
+ * NOTE: needs the TaskManager(gdt) constructor
+ */
+Task* TaskManager::CreateThread(void (*entrypoint)(void*), void* argument, uint8_t priority) {
+  if (gdt == 0) return 0;
+
+  Task* task = new Task(gdt, entrypoint, argument);
+  if (task == 0) return 0;
+
+  task->priority = (priority < Task::NUM_PRIORITIES) ? priority : Task::NUM_PRIORITIES - 1;
+  uint32_t eflags = SaveInterrupts();
+  task->cpu = CPU::Current();
+  RestoreInterrupts(eflags);
+  if (!AddTask(task)) {
+    delete task;
+    return 0;
+  }
+  return task;
+}
+
+
+/**
+ * [waits until task has exited, then forgets it (and frees it if it is a thread)]
+ * NOTE: called from a task or kernelMain, never from an interrupt handler or deferred work, those run on
+ * the stack of whatever task they interrupted
+ */
+void TaskManager::Join(Task* task) {
+  uint32_t eflags = SaveInterrupts();
+  Lock();
+  while (task->state != TaskState::Zombie) {
+    Task* current = runQueues[CPU::Current()].current;
+    // NOTE: set under the lock, an Exit() on another CPU right after Unlock() must see the joiner, its
+    // wake is then remembered (wakePending) until Block()
+    task->joiner = current;
+    Unlock();
+    if (current == 0) {
+      asm volatile("sti; hlt; cli");  // NOTE: the idle context cannot block
+    } else {
+      Block();
+    }
+    Lock();
+  }
+
+  for (int i = 0; i < numTasks; i++) {
+    if (tasks[i] != task) continue;
+
+    for (int j = i; j < numTasks - 1; j++) tasks[j] = tasks[j + 1];
+    numTasks--;
+    break;
+  }
+  Unlock();
+  RestoreInterrupts(eflags);
+
+  // NOTE: the CPU it exited on may still be switching away from its stack
+  while (task->running) asm volatile("pause");
+  if (task->thread) delete task;
+}
+
+
+void TaskManager::SetPriority(Task* task, uint8_t priority) {
+  if (priority >= Task::NUM_PRIORITIES) priority = Task::NUM_PRIORITIES - 1;
+
+  uint32_t eflags = SaveInterrupts();
+  Lock();
+  RunQueue* runQueue = &runQueues[task->cpu];
+  bool queued = false;
+  if (task->state == TaskState::Runnable && task != runQueue->current) {
+    // unlink from the old run queue
+    uint8_t p = task->priority;
+    Task* previous = 0;
+    for (Task* t = runQueue->head[p]; t != 0; previous = t, t = t->next) {
+      if (t != task) continue;
+      if (previous != 0)
+        previous->next = t->next;
+      else
+        runQueue->head[p] = t->next;
+      if (runQueue->tail[p] == t) runQueue->tail[p] = previous;
+      if (runQueue->head[p] == 0) runQueue->readyBitmap &= ~(1u << p);
+      runQueue->count--;
+      queued = true;
+      break;
+    }
+  }
+
+  task->priority = priority;
+  if (queued) Enqueue(task);
+  // NOTE: may have been lowered, another CPU notices at its next tick
+  if (task == runQueue->current && runQueue->readyBitmap != 0) runQueue->needReschedule = true;
+  Unlock();
+  RestoreInterrupts(eflags);
+}
+
+
+/**
+ * [marks the calling task as a zombie, it is never scheduled again and waits for Join()]
+ */
+void TaskManager::Exit() {
+  TaskManager* taskManager = activeTaskManager;
+  asm volatile("cli");
+  Task* task = (taskManager != 0) ? taskManager->GetCurrentTask() : 0;
+  if (task == 0) {
+    asm volatile("sti");
+    printf(RED_COLOR, BLACK_COLOR, "[TASK] Exit() called outside of a task\n");
+    return;
+  }
+
+  taskManager->Lock();
+  task->state = TaskState::Zombie;
+  if (task->joiner != 0) taskManager->MakeRunnable(task->joiner);
+  taskManager->Unlock();
+
+  Yield();
+  while (true) asm volatile("sti; hlt");  // NOTE: not reached, zombies are never scheduled again
+}
+
+
+/**
+ * [switches away through the syscall interrupt, the InterruptManager schedules on its way out]
+ */
+void TaskManager::Yield() {
+  TaskManager* taskManager = activeTaskManager;
+  if (taskManager == 0) return;
+
+  uint32_t eflags = SaveInterrupts();
+  taskManager->runQueues[CPU::Current()].needReschedule = true;
+  asm volatile("int $0x80" : : "a"(SYSCALL_YIELD) : "memory");
+  RestoreInterrupts(eflags);
+}
+
+
+/**
+ * [puts the current task to sleep until Wake(), returns once it runs again]
+ * NOTE: call with interrupts disabled after checking the wait condition. a Wake() from another CPU
+ * between the check and the switch is remembered (wakePending), so Block() may return early and the
+ * caller has to check its condition again
+ */
+void TaskManager::Block() {
+  if (!CanSleep()) return;  // NOTE: neither the idle context nor interrupt context can block
+
+  Lock();
+  Task* current = runQueues[CPU::Current()].current;
+  if (current->wakePending) {
+    current->wakePending = false;
+    Unlock();
+    return;
+  }
+  current->state = TaskState::Blocked;
+  Unlock();
+  Yield();
+}
+
+
+/**
+ * [Wake() with the lock held]
+ */
+void TaskManager::MakeRunnable(Task* task) {
+  if (task->state == TaskState::Sleeping) {
+    Task** link = &sleepQueue;
+    while (*link != 0 && *link != task) link = &(*link)->next;
+    if (*link != 0) *link = task->next;
+  }
+
+  if (task->state == TaskState::Blocked || task->state == TaskState::Sleeping) {
+    task->state = TaskState::Runnable;
+    task->wakePending = false;
+    // NOTE: a task that has not switched away yet is still its CPU's current one, it is not queued
+    if (task != runQueues[task->cpu].current) Enqueue(task);
+  } else if (task->state == TaskState::Runnable) {
+    task->wakePending = true;
+  }
+}
+
+
+/**
+ * [makes a blocked or sleeping task runnable again, callable from interrupt handlers and any CPU]
+ */
+void TaskManager::Wake(Task* task) {
+  uint32_t eflags = SaveInterrupts();
+  Lock();
+  MakeRunnable(task);
+  Unlock();
+  RestoreInterrupts(eflags);
+}
+
+
+/**
+ * [forgets a pending Wake() of the current task, for a waiter that has stopped listening for it]
+ * NOTE: the waker must not be able to reach the task anymore, or the Wake() may still come afterwards
+ */
+void TaskManager::ClearPendingWake() {
+  uint32_t eflags = SaveInterrupts();
+  Lock();
+  Task* current = runQueues[CPU::Current()].current;
+  if (current != 0) current->wakePending = false;
+  Unlock();
+  RestoreInterrupts(eflags);
+}
+
+
+/**
+ * [puts the current task to sleep for duration timer ticks, other tasks run meanwhile]
+ * e.g.:
+ * TaskManager::activeTaskManager->Sleep(10);
+ * ProgrammableIntervalTimer::activeTimer->Sleep(100);  // milliseconds
+ * NOTE: where the caller cannot block (see CanSleep()) it halts until the tick instead
+ */
+void TaskManager::Sleep(uint32_t duration) {
+  SMP::SyncTick();  // NOTE: on an AP, ticks may be stale while CPU 0 idles
+  uint32_t eflags = SaveInterrupts();
+  uint32_t wakeTick = ticks + duration;
+
+  if (!CanSleep()) {
+    // NOTE: ticks only advance with interrupts enabled, with them disabled there is no waiting
+    while ((eflags & 0x200) && (int32_t)(ticks - wakeTick) < 0) asm volatile("sti; hlt; cli");
+    RestoreInterrupts(eflags);
+    return;
+  }
+
+  Lock();
+  Task* current = runQueues[CPU::Current()].current;
+  if (current->wakePending) {
+    // NOTE: woken from another CPU between the caller's check and here, e.g. an ARP reply
+    current->wakePending = false;
+    Unlock();
+    RestoreInterrupts(eflags);
+    return;
+  }
+  current->wakeTick = wakeTick;
+  current->state = TaskState::Sleeping;
+
+  // sorted insert, equal wake ticks keep their order
+  Task** link = &sleepQueue;
+  while (*link != 0 && (int32_t)((*link)->wakeTick - wakeTick) <= 0) link = &(*link)->next;
+  current->next = *link;
+  *link = current;
+  Unlock();
+  SMP::NotifyDeadline(wakeTick);
+
+  Yield();
+  RestoreInterrupts(eflags);
+}
+
+
+bool TaskManager::CanSleep() {
+  return GetCurrentTask() != 0 && !InterruptManager::InInterrupt();
+}
+
+
+uint32_t TaskManager::GetTicks() {
+  return ticks;
+}
+
+
+/**
+ * [ticks until the first sleeper is due, the tickless idle loop sleeps at most this long]
+ */
+uint32_t TaskManager::GetTicksUntilWakeup() {
+  uint32_t eflags = SaveInterrupts();
+  Lock();
+  uint32_t ticksLeft = 0xFFFFFFFF;
+  if (sleepQueue != 0) {
+    int32_t left = (int32_t)(sleepQueue->wakeTick - ticks);
+    ticksLeft = left < 1 ? 1 : left;
+  }
+  Unlock();
+  RestoreInterrupts(eflags);
+  return ticksLeft;
+}
+
+
+/**
+ * [the task running on the calling CPU]
+ */
+Task* TaskManager::GetCurrentTask() {
+  uint32_t eflags = SaveInterrupts();
+  Task* current = runQueues[CPU::Current()].current;
+  RestoreInterrupts(eflags);
+  return current;
+}
+
+
+uint32_t TaskManager::GetIdleTicks() {
+  uint32_t idleTicks = 0;
+  for (uint32_t cpu = 0; cpu < CPU::MAX_CPUS; cpu++) idleTicks += runQueues[cpu].idleTicks;
+  return idleTicks;
 }
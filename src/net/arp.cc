@@ -1,7 +1,10 @@
+#include <drivers/timer.h>
 #include <net/arp.h>
 
 using namespace os;
 using namespace os::common;
+using namespace os::drivers;
+using namespace os::hardwarecommunication;
 using namespace os::utils;
 using namespace os::net;
 
@@ -9,6 +12,7 @@ using namespace os::net;
 AddressResolutionProtocol::AddressResolutionProtocol(EtherFrameProvider* backend)
     : EtherFrameHandler(backend, 0x806) {
   numCacheEntries = 0;
+  numResolvers = 0;
 }
 
 AddressResolutionProtocol::~AddressResolutionProtocol() {}
@@ -102,13 +106,21 @@ bool AddressResolutionProtocol::OnEtherFrameReceived(uint8_t* etherframePayload,
           return true;
           break;
 
-        case 0x0200:  // response
+        case 0x0200: {  // response
+          uint32_t eflags = cacheLock.WriteLock();
           if (numCacheEntries < 128) {
             IPcache[numCacheEntries] = arp->srcIP;
             MACcache[numCacheEntries] = arp->srcMAC;
             numCacheEntries++;
           }
+          // NOTE: woken under the cache lock (it may take the scheduler lock), once a resolver has
+          // taken itself off the list no reply can wake it anymore
+          TaskManager* taskManager = TaskManager::activeTaskManager;
+          for (uint32_t i = 0; i < numResolvers && taskManager != 0; i++)
+            taskManager->Wake(resolvers[i]);
+          cacheLock.WriteUnlock(eflags);
           break;
+        }
       }
     }
   }
@@ -133,25 +145,96 @@ void AddressResolutionProtocol::RequestMACAddress(uint32_t IP_BE) {
 }
 
 
-uint64_t AddressResolutionProtocol::GetMACFromCache(uint32_t IP_BE) {
+/**
+ * [cache lookup, cacheLock must be held]
+ */
+uint64_t AddressResolutionProtocol::LookUp(uint32_t IP_BE) {
   for (int i = 0; i < numCacheEntries; i++)
     if (IPcache[i] == IP_BE) return MACcache[i];
   return 0xFFFFFFFFFFFF;  // broadcast address
 }
 
 
-uint64_t AddressResolutionProtocol::Resolve(uint32_t IP_BE) {
-  uint64_t result = GetMACFromCache(IP_BE);
-  if (result == 0xffffffffffff) {
-    RequestMACAddress(IP_BE);
+bool AddressResolutionProtocol::AddResolver(Task* task) {
+  if (numResolvers == sizeof(resolvers) / sizeof(resolvers[0])) return false;
+  resolvers[numResolvers++] = task;
+  return true;
+}
+
+
+void AddressResolutionProtocol::RemoveResolver(Task* task) {
+  for (uint32_t i = 0; i < numResolvers; i++) {
+    if (resolvers[i] != task) continue;
+    resolvers[i] = resolvers[--numResolvers];
+    return;
   }
+}
+
+
+/**
+ * [cached MAC address of IP_BE, the broadcast address if there is none]
+ * PERFORMANCE: takes the cache lock as a reader, lookups on several CPUs do not wait for each other
+ */
+uint64_t AddressResolutionProtocol::GetMACFromCache(uint32_t IP_BE) {
+  uint32_t eflags = cacheLock.ReadLock();
+  uint64_t result = LookUp(IP_BE);
+  cacheLock.ReadUnlock(eflags);
+  return result;
+}
+
+
+LockStats AddressResolutionProtocol::GetLockStats() {
+  return cacheLock.GetStats();
+}
+
 
-  uint8_t attempts = 0;
-  while (result == 0xffffffffffff && attempts < 128) {
-    result = this->GetMACFromCache(IP_BE);
-    attempts++;
+/**
+ * [looks IP_BE up in the cache, on a miss sends a request and sleeps until the reply or timeout (ms)]
+ * NOTE: only a task can wait, in interrupt context and in kernelMain the cache is checked once more.
+ * any number of tasks may wait at once, the first 8 are woken by the reply, the others poll every tick
+ */
+uint64_t AddressResolutionProtocol::Resolve(uint32_t IP_BE, uint32_t timeout) {
+  uint64_t result = GetMACFromCache(IP_BE);
+  if (result != 0xffffffffffff) return result;
+
+  RequestMACAddress(IP_BE);
+
+  TaskManager* taskManager = TaskManager::activeTaskManager;
+  ProgrammableIntervalTimer* timer = ProgrammableIntervalTimer::activeTimer;
+  if (taskManager != 0 && timer != 0 && taskManager->CanSleep()) {
+    uint32_t deadline = taskManager->GetTicks() + timer->MillisecondsToTicks(timeout);
+
+    Task* current = taskManager->GetCurrentTask();
+
+    while (true) {
+      uint32_t eflags = cacheLock.WriteLock();
+      result = LookUp(IP_BE);
+      int32_t remaining = (int32_t)(deadline - taskManager->GetTicks());
+      bool wait = result == 0xffffffffffff && remaining > 0;
+      bool listed = wait && AddResolver(current);
+      cacheLock.WriteUnlock(eflags);
+      if (!wait) break;
+
+      // NOTE: a reply between the unlock and the sleep (on this CPU or another) leaves a pending
+      // Wake(), Sleep() then returns right away, so it cannot be missed. with the list full the cache
+      // is polled once per tick instead
+      taskManager->Sleep(listed ? remaining : 1);
+
+      if (listed) {
+        eflags = cacheLock.WriteLock();
+        RemoveResolver(current);
+        cacheLock.WriteUnlock(eflags);
+      }
+    }
+
+    // NOTE: a reply may have woken it after Sleep() had already timed out, the next unrelated Sleep() or
+    // Block() would return right away
+    taskManager->ClearPendingWake();
+  } else {
+    result = GetMACFromCache(IP_BE);  // NOTE: the reply may have arrived in the receive interrupt
   }
-  if (attempts >= 128) {
+
+  if (result == 0xffffffffffff) {
     printf("\nARP Resolve Time Out.\n");
   }
   return result;
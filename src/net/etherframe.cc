@@ -1,9 +1,11 @@
 #include <net/etherframe.h>
+#include <utils/memory.h>
 
 using namespace os;
 using namespace os::common;
 using namespace os::net;
 using namespace os::drivers;
+using namespace os::utils;
 
 EtherFrameHandler::EtherFrameHandler(EtherFrameProvider* backend, uint16_t etherType) {
   this->etherType_BE = ((etherType & 0x00FF) << 8) | ((etherType & 0xFF00) >> 8);  // HACK: convert to big endian
@@ -26,6 +28,11 @@ void EtherFrameHandler::Send(uint64_t dstMAC_BE, uint8_t* data, uint32_t size) {
   backend->Send(dstMAC_BE, etherType_BE, data, size);
 }
 
+
+void EtherFrameHandler::Send(uint64_t dstMAC_BE, NetBuffer* packet) {
+  backend->Send(dstMAC_BE, etherType_BE, packet);
+}
+
 EtherFrameProvider::EtherFrameProvider(amd_am79c973* backend) : drivers::RawDataHandler(backend) {
   for (uint32_t i = 0; i < 65535; i++) handlers[i] = 0;
 }
@@ -56,21 +63,36 @@ bool EtherFrameProvider::OnRawDataReceived(uint8_t* buffer, uint32_t size) {
 
   return sendBack;
 }
+/**
+ * [sends a payload that is not in a NetBuffer yet (e.g. an ARP message built on the stack)]
+ */
 void EtherFrameProvider::Send(uint64_t dstMAC_BE, uint16_t etherType_BE, uint8_t* data, uint32_t size) {
-  uint8_t* buffer = (uint8_t*)MemoryManager::activeMemoryManager->malloc(sizeof(EtherFrameHeader) + size);
-  EtherFrameHeader* frame = (EtherFrameHeader*)buffer;
+  NetBuffer* packet = (NetBufferPool::activePool != 0) ? NetBufferPool::activePool->Alloc() : 0;
+  if (packet == 0) return;  // NOTE: no pool or pool exhausted, the packet is dropped
+
+  uint8_t* payload = packet->Put(size);
+  if (payload == 0) {
+    packet->Release();
+    return;
+  }
+  memcpy(payload, data, size);
+
+  Send(dstMAC_BE, etherType_BE, packet);
+}
+
+
+void EtherFrameProvider::Send(uint64_t dstMAC_BE, uint16_t etherType_BE, NetBuffer* packet) {
+  EtherFrameHeader* frame = (EtherFrameHeader*)packet->Push(sizeof(EtherFrameHeader));
+  if (frame == 0) {
+    packet->Release();
+    return;
+  }
 
   frame->dstMac_BE = dstMAC_BE;
   frame->srcMac_BE = backend->GetMACAddress();
   frame->etherType_BE = etherType_BE;
 
-  uint8_t* src = data;
-  uint8_t* dst = buffer + sizeof(EtherFrameHeader);
-  for (uint32_t i = 0; i < size; i++) dst[i] = src[i];
-
-  backend->Send(buffer, size + sizeof(EtherFrameHeader));
-
-  MemoryManager::activeMemoryManager->free(buffer);
+  backend->Send(packet);  // NOTE: zero-copy, the NIC releases the packet once it is transmitted
 }
 
 
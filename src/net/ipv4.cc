@@ -1,4 +1,5 @@
 #include <net/ipv4.h>
+#include <utils/memory.h>
 
 using namespace os;
 using namespace os::common;
@@ -97,10 +98,18 @@ bool InternetProtocolProvider::OnEtherFrameReceived(uint8_t* etherframePayload,
 
 
 void InternetProtocolProvider::Send(uint32_t dstIP_BE, uint8_t protocol, uint8_t* data, uint32_t size) {
-  // uint8_t* buffer = (uint8_t*)MemoryManager::activeMemoryManager->malloc(sizeof(InternetProtocolMessage) + size);
-  // REFACTOR:
-  uint8_t* buffer = new uint8_t[sizeof(InternetProtocolMessage) + size];
-  InternetProtocolMessage* message = (InternetProtocolMessage*)buffer;
+  // NOTE: payload and both headers are built in one pooled buffer, no heap allocation per packet
+  NetBuffer* packet = (NetBufferPool::activePool != 0) ? NetBufferPool::activePool->Alloc() : 0;
+  if (packet == 0) return;  // no pool or pool exhausted, the packet is dropped
+
+  uint8_t* databuffer = packet->Put(size);
+  InternetProtocolMessage* message = 0;
+  if (databuffer != 0) message = (InternetProtocolMessage*)packet->Push(sizeof(InternetProtocolMessage));
+  if (message == 0) {
+    packet->Release();
+    return;
+  }
+  memcpy(databuffer, data, size);
 
   message->version = 4;
   message->headerLength = sizeof(InternetProtocolMessage) / 4;
@@ -120,11 +129,6 @@ void InternetProtocolProvider::Send(uint32_t dstIP_BE, uint8_t protocol, uint8_t
                           // non-zero value will lead to the wrong checksum calculation
   message->checksum = Checksum((uint16_t*)(void*)message, sizeof(InternetProtocolMessage));
 
-  uint8_t* databuffer = buffer + sizeof(InternetProtocolMessage);
-  for (int i = 0; i < size; i++) {
-    databuffer[i] = data[i];
-  }
-
   // uint32_t route = dstIP_BE;
   /* if the destination is not within our own subnet/LAN,
      then, we don't talk to the target directly,
@@ -132,11 +136,7 @@ void InternetProtocolProvider::Send(uint32_t dstIP_BE, uint8_t protocol, uint8_t
   */
   if ((dstIP_BE & subnetMask) != (message->srcIP & subnetMask)) dstIP_BE = gatewayIP;
 
-  backend->Send(arp->Resolve(dstIP_BE), this->etherType_BE, buffer, sizeof(InternetProtocolMessage) + size);
-
-  // MemoryManager::activeMemoryManager->free(buffer);
-  // REFACTOR:
-  delete[] buffer;
+  EtherFrameHandler::Send(arp->Resolve(dstIP_BE), packet);  // NOTE: takes ownership of packet
 }
 
 
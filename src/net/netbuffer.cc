@@ -0,0 +1,199 @@
+#include <memory/buddy.h>
+#include <net/netbuffer.h>
+
+using namespace os;
+using namespace os::common;
+using namespace os::memory;
+using namespace os::net;
+
+NetBufferPool* NetBufferPool::activePool = 0;
+
+
+NetBuffer::NetBuffer() {
+  next = 0;
+  pool = 0;
+  storage = 0;
+  data = 0;
+  length = 0;
+}
+
+
+NetBuffer::~NetBuffer() {}
+
+
+void NetBuffer::Reset() {
+  data = storage + HEADROOM;
+  length = 0;
+}
+
+
+uint8_t* NetBuffer::Push(uint32_t size) {
+  if (size > Headroom()) return 0;
+  data -= size;
+  length += size;
+  return data;
+}
+
+
+uint8_t* NetBuffer::Put(uint32_t size) {
+  if (size > Tailroom()) return 0;
+  uint8_t* tail = data + length;
+  length += size;
+  return tail;
+}
+
+
+void NetBuffer::Pull(uint32_t size) {
+  if (size > length) size = length;
+  data += size;
+  length -= size;
+}
+
+
+uint8_t* NetBuffer::Data() {
+  return data;
+}
+
+
+uint32_t NetBuffer::Length() {
+  return length;
+}
+
+
+uint32_t NetBuffer::Headroom() {
+  return data - storage;
+}
+
+
+uint32_t NetBuffer::Tailroom() {
+  return CAPACITY - Headroom() - length;
+}
+
+
+void NetBuffer::Release() {
+  if (pool != 0) pool->Free(this);
+}
+
+
+NetBufferQueue::NetBufferQueue() {
+  head = 0;
+  tail = 0;
+  count = 0;
+}
+
+
+NetBufferQueue::~NetBufferQueue() {
+  for (NetBuffer* buffer = Dequeue(); buffer != 0; buffer = Dequeue()) buffer->Release();
+}
+
+
+void NetBufferQueue::Enqueue(NetBuffer* buffer) {
+  buffer->next = 0;
+  if (tail != 0)
+    tail->next = buffer;
+  else
+    head = buffer;
+  tail = buffer;
+  count++;
+}
+
+
+NetBuffer* NetBufferQueue::Dequeue() {
+  NetBuffer* buffer = head;
+  if (buffer == 0) return 0;
+
+  head = buffer->next;
+  if (head == 0) tail = 0;
+  buffer->next = 0;
+  count--;
+  return buffer;
+}
+
+
+uint32_t NetBufferQueue::Count() {
+  return count;
+}
+
+
+/**
+ * [preallocates count buffers]
+ * e.g.:
+ * NetBufferPool netBuffers(64);
+ * NetBuffer* packet = NetBufferPool::activePool->Alloc();
+ * NOTE: the storage is count * NetBuffer::CAPACITY bytes of DMA memory from the buddy allocator, without
+ * one (or out of memory) the pool stays empty and every Alloc() fails
+ */
+NetBufferPool::NetBufferPool(uint32_t count) {
+  activePool = this;
+
+  freeList = 0;
+  freeCount = 0;
+  failures = 0;
+
+  BuddyAllocator* buddy = BuddyAllocator::activeBuddyAllocator;
+  storage = (buddy != 0) ? (uint8_t*)buddy->AllocContiguous(count * NetBuffer::CAPACITY) : 0;
+  if (storage == 0) {
+    buffers = 0;
+    this->count = 0;
+    return;
+  }
+
+  buffers = new NetBuffer[count];
+  this->count = count;
+  for (uint32_t i = 0; i < count; i++) {
+    buffers[i].pool = this;
+    buffers[i].storage = storage + i * NetBuffer::CAPACITY;
+    Free(&buffers[i]);
+  }
+}
+
+
+NetBufferPool::~NetBufferPool() {
+  if (activePool == this) activePool = 0;
+  if (buffers != 0) delete[] buffers;
+  if (storage != 0) BuddyAllocator::activeBuddyAllocator->FreeContiguous(storage);
+}
+
+
+NetBuffer* NetBufferPool::Alloc() {
+  uint32_t eflags = lock.Lock();
+  if (freeList == 0) {
+    failures++;
+    lock.Unlock(eflags);
+    return 0;
+  }
+
+  NetBuffer* buffer = freeList;
+  freeList = buffer->next;
+  freeCount--;
+  lock.Unlock(eflags);
+
+  buffer->next = 0;
+  buffer->Reset();
+  return buffer;
+}
+
+
+void NetBufferPool::Free(NetBuffer* buffer) {
+  if (buffer == 0) return;
+  uint32_t eflags = lock.Lock();
+  buffer->next = freeList;
+  freeList = buffer;
+  freeCount++;
+  lock.Unlock(eflags);
+}
+
+
+uint32_t NetBufferPool::GetCount() {
+  return count;
+}
+
+
+uint32_t NetBufferPool::GetFreeCount() {
+  return freeCount;
+}
+
+
+uint32_t NetBufferPool::GetFailures() {
+  return failures;
+}
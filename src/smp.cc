@@ -0,0 +1,315 @@
+#include <drivers/clock.h>
+#include <fpu.h>
+#include <smp.h>
+#include <utils/memory.h>
+
+using namespace os;
+using namespace os::common;
+using namespace os::drivers;
+using namespace os::utils;
+using namespace os::hardwarecommunication;
+
+// smptrampoline.s
+extern "C" uint8_t smp_trampoline_start[];
+extern "C" uint8_t smp_trampoline_params[];
+extern "C" uint8_t smp_trampoline_end[];
+
+
+uint8_t CPU::indexByAPICID[256];
+volatile bool CPU::indexed = false;
+volatile uint32_t CPU::online = 1;  // the bootstrap processor
+
+
+/**
+ * [the calling CPU's number, looked up by its Local APIC ID]
+ * PERFORMANCE: one Local APIC register read, and none until a second CPU is being started
+ */
+uint32_t CPU::Current() {
+  if (!indexed || LocalAPIC::activeLocalAPIC == 0) return 0;
+  return indexByAPICID[LocalAPIC::activeLocalAPIC->GetID()];
+}
+
+
+uint32_t CPU::Count() {
+  return online;
+}
+
+
+SMP* SMP::activeSMP = 0;
+
+
+/**
+ * [lists the CPUs, the ACPI MADT first, the MP table otherwise, they are started by StartAPs()]
+ */
+SMP::SMP(
+    GlobalDescriptorTable* gdt,
+    InterruptManager* interrupts,
+    LocalAPIC* localAPIC,
+    TaskManager* taskManager
+)
+    : InterruptHandler(interrupts, interrupts->HardwareInterruptOffset() + RESCHEDULE_INTERRUPT) {
+  this->gdt = gdt;
+  this->interrupts = interrupts;
+  this->localAPIC = localAPIC;
+  this->taskManager = taskManager;
+  numCPUs = 0;
+  startingCPU = 0;
+  started = false;
+  activeSMP = this;
+
+  if (!localAPIC->IsPresent()) return;
+  AddCPU(localAPIC->GetID());  // NOTE: CPU 0
+
+  if (!FindMADT() && !FindMPTable())
+    printf(LIGHT_GRAY_COLOR, BLACK_COLOR, "[SMP] no MADT or MP table, only CPU 0\n");
+  printf(LIGHT_GRAY_COLOR, BLACK_COLOR, "[SMP] %d CPUs found\n", numCPUs);
+}
+
+
+SMP::~SMP() {
+  if (activeSMP == this) activeSMP = 0;
+}
+
+
+void SMP::AddCPU(uint8_t apicID) {
+  for (uint32_t i = 0; i < numCPUs; i++)
+    if (apicIDs[i] == apicID) return;
+  if (numCPUs < CPU::MAX_CPUS) apicIDs[numCPUs++] = apicID;
+}
+
+
+/**
+ * [searches [start, start + length) for a signature on a 16-byte boundary whose size bytes sum to zero]
+ */
+uint8_t* SMP::FindSignature(uint32_t start, uint32_t length, const char* signature, uint32_t size) {
+  uint32_t signatureLength = 0;
+  while (signature[signatureLength] != 0) signatureLength++;
+
+  for (uint32_t address = start; address + size <= start + length; address += 16) {
+    uint8_t* candidate = (uint8_t*)address;
+    if (memcmp(candidate, signature, signatureLength) != 0) continue;
+
+    uint8_t sum = 0;
+    for (uint32_t i = 0; i < size; i++) sum += candidate[i];
+    if (sum == 0) return candidate;
+  }
+  return 0;
+}
+
+
+/**
+ * [ACPI: RSDP -> RSDT -> MADT ("APIC"), every enabled processor Local APIC entry is a CPU]
+ * NOTE: the EBDA pointer at 0x40E lies in the unmapped page 0, the last KiB of base memory is searched
+ * instead, that is where the EBDA sits on practically every PC
+ */
+bool SMP::FindMADT() {
+  uint8_t* rsdp = FindSignature(0x9FC00, 0x400, "RSD PTR ", 20);
+  if (rsdp == 0) rsdp = FindSignature(0xE0000, 0x20000, "RSD PTR ", 20);
+  if (rsdp == 0) return false;
+
+  uint8_t* rsdt = (uint8_t*)*(uint32_t*)(rsdp + 16);
+  if (rsdt == 0 || memcmp(rsdt, "RSDT", 4) != 0) return false;
+
+  uint32_t rsdtLength = *(uint32_t*)(rsdt + 4);
+  for (uint32_t offset = 36; offset + 4 <= rsdtLength; offset += 4) {
+    uint8_t* table = (uint8_t*)*(uint32_t*)(rsdt + offset);
+    if (memcmp(table, "APIC", 4) != 0) continue;
+
+    // entries: type, length, ... from offset 44 on, type 0 := processor Local APIC
+    uint32_t tableLength = *(uint32_t*)(table + 4);
+    for (uint32_t entry = 44; entry + 2 <= tableLength; entry += table[entry + 1]) {
+      if (table[entry + 1] == 0) break;  // NOTE: a broken entry would loop forever
+      if (table[entry] != 0) continue;
+      uint8_t apicID = table[entry + 3];
+      uint32_t flags = *(uint32_t*)(table + entry + 4);
+      if (flags & 1) AddCPU(apicID);  // enabled
+    }
+    return true;
+  }
+  return false;
+}
+
+
+/**
+ * [Intel MP table: floating pointer "_MP_" -> configuration table "PCMP"]
+ * processor entries are 20 bytes, every other entry 8
+ */
+bool SMP::FindMPTable() {
+  uint8_t* pointer = FindSignature(0x9FC00, 0x400, "_MP_", 16);
+  if (pointer == 0) pointer = FindSignature(0xF0000, 0x10000, "_MP_", 16);
+  if (pointer == 0) return false;
+
+  // NOTE: 0 := one of the default configurations, they have no table to read the CPUs from
+  uint8_t* table = (uint8_t*)*(uint32_t*)(pointer + 4);
+  if (table == 0 || memcmp(table, "PCMP", 4) != 0) return false;
+
+  uint16_t entries = *(uint16_t*)(table + 34);
+  uint8_t* entry = table + 44;
+  for (uint16_t i = 0; i < entries; i++) {
+    if (entry[0] != 0) {
+      entry += 8;
+      continue;
+    }
+    if (entry[3] & 1) AddCPU(entry[1]);  // enabled
+    entry += 20;
+  }
+  return true;
+}
+
+
+/**
+ * [starts every CPU found but the bootstrap processor, one after the other]
+ * NOTE: call after InterruptManager::Activate() and LocalAPIC::StartTimer(), the APs take over the IDT
+ * and the timer rate
+ */
+uint32_t SMP::StartAPs() {
+  Clock* clock = Clock::activeClock;
+  if (numCPUs <= 1 || clock == 0 || !clock->HasTSC()) return CPU::Count();
+
+  memcpy((void*)TRAMPOLINE_ADDRESS, smp_trampoline_start, smp_trampoline_end - smp_trampoline_start);
+  TrampolineParams* params =
+      (TrampolineParams*)(TRAMPOLINE_ADDRESS + (smp_trampoline_params - smp_trampoline_start));
+  asm volatile("mov %%cr0, %0" : "=r"(params->cr0));
+  asm volatile("mov %%cr3, %0" : "=r"(params->cr3));
+  asm volatile("mov %%cr4, %0" : "=r"(params->cr4));
+  params->entry = (uint32_t)&APMain;
+
+  CPU::indexByAPICID[apicIDs[0]] = 0;
+  CPU::indexed = true;
+
+  uint32_t found = numCPUs;
+  numCPUs = 1;
+  for (uint32_t i = 1; i < found; i++) {
+    uint8_t apicID = apicIDs[i];
+    uint8_t* stack = new uint8_t[AP_STACK_SIZE];
+    if (stack == 0) break;
+    params->stack = ((uint32_t)stack + AP_STACK_SIZE) & ~0xF;
+
+    // NOTE: CPU numbers stay dense, one that does not come up leaves no gap
+    apicIDs[numCPUs] = apicID;
+    if (StartAP(numCPUs)) {
+      numCPUs++;
+      continue;
+    }
+    delete[] stack;
+    printf(RED_COLOR, BLACK_COLOR, "[SMP] CPU with APIC ID %d did not start\n", apicID);
+  }
+
+  printf(LIGHT_GRAY_COLOR, BLACK_COLOR, "[SMP] %d CPUs online\n", CPU::Count());
+  return CPU::Count();
+}
+
+
+/**
+ * [INIT, wait 10 ms, STARTUP, wait 200 us, STARTUP again if it has not answered, then up to 100 ms for
+ * APMain() to report in]
+ */
+bool SMP::StartAP(uint32_t cpu) {
+  Clock* clock = Clock::activeClock;
+  uint8_t apicID = apicIDs[cpu];
+
+  CPU::indexByAPICID[apicID] = cpu;
+  startingCPU = cpu;
+  started = false;
+
+  uint32_t eflags = SaveInterrupts();
+  localAPIC->SendIPI(apicID, 0x4500);  // INIT, level assert
+  RestoreInterrupts(eflags);
+  clock->Delay(10000000);
+
+  for (int sipi = 0; sipi < 2 && !started; sipi++) {
+    eflags = SaveInterrupts();
+    localAPIC->SendIPI(apicID, 0x4600 | (TRAMPOLINE_ADDRESS >> 12));  // STARTUP, vector := page
+    RestoreInterrupts(eflags);
+    clock->Delay(200000);
+  }
+
+  for (int ms = 0; ms < 100 && !started; ms++) clock->Delay(1000000);
+  if (started) return true;
+
+  // NOTE: back into wait-for-SIPI, a late start would take a CPU number that is handed out again
+  eflags = SaveInterrupts();
+  localAPIC->SendIPI(apicID, 0x4500);
+  RestoreInterrupts(eflags);
+  return false;
+}
+
+
+/**
+ * [entry of an application processor, called by the trampoline on its own stack with paging enabled]
+ * joins the scheduler, then idles like kernelMain: the TaskManager switches away from here whenever
+ * there is a task for this CPU
+ */
+void SMP::APMain() {
+  SMP* smp = activeSMP;
+  smp->gdt->Load();
+  smp->interrupts->LoadInterruptDescriptorTable();
+  smp->localAPIC->InitAP();
+  if (FPU::activeFPU != 0) FPU::InitCPU();
+
+  CPU::online = smp->startingCPU + 1;
+  smp->started = true;
+
+  while (true) {
+    asm volatile("cli");
+    if (smp->interrupts->HasDeferredWork()) {
+      asm volatile("sti");
+      smp->interrupts->RunDeferredWork();
+      continue;
+    }
+    smp->localAPIC->EnterIdle();
+    asm volatile("sti; hlt");
+  }
+}
+
+
+/**
+ * [reschedule IPI, the InterruptManager schedules on its way out since the sender set NeedsReschedule()]
+ */
+uint32_t SMP::HandleInterrupt(uint32_t esp) {
+  localAPIC->EndOfInterrupt();
+  return esp;
+}
+
+
+void SMP::SendReschedule(uint32_t cpu) {
+  if (cpu >= CPU::Count()) return;
+  uint8_t vector = interrupts->HardwareInterruptOffset() + RESCHEDULE_INTERRUPT;
+  localAPIC->SendIPI(apicIDs[cpu], 0x4000 | vector);  // fixed delivery, level assert
+}
+
+
+/**
+ * [on an application processor: brings the kernel tick up to date before it is read]
+ * only CPU 0 advances the tick, in a tickless idle period it is credited when the period ends. an IPI
+ * ends it now (ExitIdle() runs on every interrupt), this waits until the ticks have been credited.
+ * NOTE: no lock may be held that the tick takes (TaskManager, TimerWheel)
+ */
+void SMP::SyncTick() {
+  SMP* smp = activeSMP;
+  if (smp == 0 || !smp->localAPIC->IsIdle(0)) return;
+
+  uint32_t eflags = SaveInterrupts();
+  if (CPU::Current() != 0) {
+    smp->SendReschedule(0);
+    while (smp->localAPIC->IsIdle(0)) asm volatile("pause");
+  }
+  RestoreInterrupts(eflags);
+}
+
+
+/**
+ * [on an application processor: a sleeper or kernel timer due at tick was added, CPU 0 gets an IPI if its
+ * tickless idle period runs past it. it then catches up and its idle loop arms the timer again]
+ * NOTE: a CPU 0 that goes idle after the caller added the event sees it in GetTicksUntilNextEvent()
+ */
+void SMP::NotifyDeadline(uint32_t tick) {
+  SMP* smp = activeSMP;
+  if (smp == 0) return;
+
+  uint32_t eflags = SaveInterrupts();
+  LocalAPIC* localAPIC = smp->localAPIC;
+  bool early = localAPIC->IsIdle(0) && (int32_t)(tick - localAPIC->GetIdleUntil()) < 0;
+  if (CPU::Current() != 0 && early) smp->SendReschedule(0);
+  RestoreInterrupts(eflags);
+}
@@ -0,0 +1,80 @@
+
+# application processor startup code, SMP::StartAPs() copies it to TRAMPOLINE_ADDRESS (0x8000) and
+# fills in the parameters at its end. the STARTUP IPI starts the AP in real mode at 0x0800:0000.
+# NOTE: it runs from the copy, so every absolute address is (label - smp_trampoline_start + 0x8000)
+
+.set TRAMPOLINE_ADDRESS, 0x8000
+.set CODE_SELECTOR, 0x10
+.set DATA_SELECTOR, 0x18
+
+.section .text
+
+.global smp_trampoline_start
+.global smp_trampoline_params
+.global smp_trampoline_end
+
+.code16
+smp_trampoline_start:
+    cli
+    cld
+    xorw %ax, %ax
+    movw %ax, %ds
+
+    # temporary GDT with the kernel's layout, the AP loads the real one in SMP::APMain()
+    lgdtl trampoline_gdt_pointer - smp_trampoline_start + TRAMPOLINE_ADDRESS
+
+    movl %cr0, %eax
+    orl $1, %eax # PE
+    movl %eax, %cr0
+    ljmpl $CODE_SELECTOR, $(trampoline_protected - smp_trampoline_start + TRAMPOLINE_ADDRESS)
+
+.code32
+trampoline_protected:
+    movw $DATA_SELECTOR, %ax
+    movw %ax, %ds
+    movw %ax, %es
+    movw %ax, %fs
+    movw %ax, %gs
+    movw %ax, %ss
+
+    # the bootstrap processor's paging: cr4 (PSE, PGE) first, then the page directory, then PG
+    movl trampoline_cr4 - smp_trampoline_start + TRAMPOLINE_ADDRESS, %eax
+    movl %eax, %cr4
+    movl trampoline_cr3 - smp_trampoline_start + TRAMPOLINE_ADDRESS, %eax
+    movl %eax, %cr3
+    movl trampoline_cr0 - smp_trampoline_start + TRAMPOLINE_ADDRESS, %eax
+    movl %eax, %cr0
+
+    movl trampoline_stack - smp_trampoline_start + TRAMPOLINE_ADDRESS, %esp
+    call *(trampoline_entry - smp_trampoline_start + TRAMPOLINE_ADDRESS)
+
+trampoline_stop:
+    cli
+    hlt
+    jmp trampoline_stop
+
+.align 8
+trampoline_gdt:
+    .quad 0
+    .quad 0
+    .quad 0x00CF9A000000FFFF # code, flat 4 GiB
+    .quad 0x00CF92000000FFFF # data, flat 4 GiB
+trampoline_gdt_pointer:
+    .word 4 * 8 - 1
+    .long trampoline_gdt - smp_trampoline_start + TRAMPOLINE_ADDRESS
+
+# NOTE: same layout as SMP::TrampolineParams
+.align 4
+smp_trampoline_params:
+trampoline_cr0:
+    .long 0
+trampoline_cr3:
+    .long 0
+trampoline_cr4:
+    .long 0
+trampoline_stack:
+    .long 0
+trampoline_entry:
+    .long 0
+
+smp_trampoline_end:
@@ -0,0 +1,221 @@
+#include <spinlock.h>
+
+using namespace os;
+using namespace os::common;
+
+
+// NOTE: same as SaveInterrupts()/RestoreInterrupts(), repeated here so that spinlock.h stays free of
+// includes, the TaskManager and the InterruptManager both use it
+static inline uint32_t DisableInterrupts() {
+  uint32_t eflags;
+  asm volatile("pushf; pop %0; cli" : "=r"(eflags) : : "memory");
+  return eflags;
+}
+
+static inline void RestoreEFLAGS(uint32_t eflags) {
+  asm volatile("push %0; popf" : : "r"(eflags) : "memory", "cc");
+}
+
+
+Spinlock::Spinlock() {
+  locked = 0;
+  stats = LockStats();
+}
+
+
+/**
+ * [xchg until it was free, the wait loop only reads so the cache line is not bounced meanwhile]
+ */
+void Spinlock::Lock() {
+  if (__sync_lock_test_and_set(&locked, 1) == 0) {
+    stats.acquisitions++;
+    return;
+  }
+
+  uint32_t spins = 0;
+  do {
+    while (locked) {
+      asm volatile("pause");
+      spins++;
+    }
+  } while (__sync_lock_test_and_set(&locked, 1) != 0);
+
+  stats.acquisitions++;
+  stats.contentions++;
+  stats.spins += spins;
+}
+
+
+bool Spinlock::TryLock() {
+  if (__sync_lock_test_and_set(&locked, 1) != 0) return false;
+  stats.acquisitions++;
+  return true;
+}
+
+
+void Spinlock::Unlock() {
+  __sync_lock_release(&locked);
+}
+
+
+bool Spinlock::IsLocked() {
+  return locked != 0;
+}
+
+
+LockStats Spinlock::GetStats() {
+  return stats;
+}
+
+
+TicketLock::TicketLock() {
+  next = 0;
+  serving = 0;
+  stats = LockStats();
+}
+
+
+void TicketLock::Lock() {
+  uint32_t ticket = __sync_fetch_and_add(&next, 1);
+  if (serving == ticket) {
+    stats.acquisitions++;
+    return;
+  }
+
+  uint32_t spins = 0;
+  while (serving != ticket) {
+    asm volatile("pause");
+    spins++;
+  }
+  asm volatile("" : : : "memory");
+
+  stats.acquisitions++;
+  stats.contentions++;
+  stats.spins += spins;
+}
+
+
+/**
+ * [takes the lock only if nobody holds or waits for it]
+ */
+bool TicketLock::TryLock() {
+  uint32_t ticket = serving;
+  if (!__sync_bool_compare_and_swap(&next, ticket, ticket + 1)) return false;
+  stats.acquisitions++;
+  return true;
+}
+
+
+void TicketLock::Unlock() {
+  // NOTE: only the holder writes serving, a plain store after a compiler barrier is enough on x86
+  asm volatile("" : : : "memory");
+  serving = serving + 1;
+}
+
+
+bool TicketLock::IsLocked() {
+  return next != serving;
+}
+
+
+LockStats TicketLock::GetStats() {
+  return stats;
+}
+
+
+IrqSpinlock::IrqSpinlock() {
+}
+
+
+/**
+ * [disables interrupts first, then spins: an interrupt taken while spinning could want this lock too]
+ */
+uint32_t IrqSpinlock::Lock() {
+  uint32_t eflags = DisableInterrupts();
+  lock.Lock();
+  return eflags;
+}
+
+
+void IrqSpinlock::Unlock(uint32_t eflags) {
+  lock.Unlock();
+  RestoreEFLAGS(eflags);
+}
+
+
+bool IrqSpinlock::IsLocked() {
+  return lock.IsLocked();
+}
+
+
+LockStats IrqSpinlock::GetStats() {
+  return lock.GetStats();
+}
+
+
+RWLock::RWLock() {
+  state = 0;
+  writersWaiting = 0;
+  stats = LockStats();
+}
+
+
+uint32_t RWLock::ReadLock() {
+  uint32_t eflags = DisableInterrupts();
+  uint32_t spins = 0;
+
+  while (true) {
+    int32_t readers = state;
+    bool free = readers >= 0 && writersWaiting == 0;
+    if (free && __sync_bool_compare_and_swap(&state, readers, readers + 1)) break;
+    asm volatile("pause");
+    spins++;
+  }
+
+  // NOTE: readers hold it together, the counters need atomic adds here
+  __sync_fetch_and_add(&stats.acquisitions, 1);
+  if (spins != 0) {
+    __sync_fetch_and_add(&stats.contentions, 1);
+    __sync_fetch_and_add(&stats.spins, spins);
+  }
+  return eflags;
+}
+
+
+void RWLock::ReadUnlock(uint32_t eflags) {
+  __sync_fetch_and_sub(&state, 1);
+  RestoreEFLAGS(eflags);
+}
+
+
+uint32_t RWLock::WriteLock() {
+  uint32_t eflags = DisableInterrupts();
+  if (__sync_bool_compare_and_swap(&state, 0, -1)) {
+    __sync_fetch_and_add(&stats.acquisitions, 1);
+    return eflags;
+  }
+
+  __sync_fetch_and_add(&writersWaiting, 1);
+  uint32_t spins = 0;
+  while (state != 0 || !__sync_bool_compare_and_swap(&state, 0, -1)) {
+    asm volatile("pause");
+    spins++;
+  }
+  __sync_fetch_and_sub(&writersWaiting, 1);
+
+  __sync_fetch_and_add(&stats.acquisitions, 1);
+  __sync_fetch_and_add(&stats.contentions, 1);
+  __sync_fetch_and_add(&stats.spins, spins);
+  return eflags;
+}
+
+
+void RWLock::WriteUnlock(uint32_t eflags) {
+  __sync_lock_release(&state);  // NOTE: stores 0 with release semantics
+  RestoreEFLAGS(eflags);
+}
+
+
+LockStats RWLock::GetStats() {
+  return stats;
+}
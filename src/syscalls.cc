@@ -21,6 +21,9 @@ uint32_t SyscallHandler::HandleInterrupt(uint32_t esp) {
       printf((char*)cpu->ebx);
       break;
 
+    case TaskManager::SYSCALL_YIELD:
+      break;  // NOTE: nothing to do, the InterruptManager schedules on the way out
+
     default:
       break;
   }
@@ -0,0 +1,211 @@
+#include <hardwarecommunication/interrupts.h>
+#include <timerwheel.h>
+
+using namespace os;
+using namespace os::common;
+using namespace os::hardwarecommunication;
+
+
+Timer::Timer(void (*function)(void*), void* argument) {
+  this->function = function;
+  this->argument = argument;
+  expires = 0;
+  next = 0;
+  pprev = 0;
+}
+
+
+bool Timer::IsPending() {
+  return pprev != 0;
+}
+
+
+TimerWheel::TimerWheel() {
+  for (uint32_t level = 0; level < LEVELS; level++)
+    for (uint32_t slot = 0; slot < SLOTS; slot++) wheel[level][slot] = 0;
+  expired = 0;
+  expiredTail = &expired;
+  currentTick = 0;
+  pending = 0;
+  runScheduled = false;
+}
+
+
+TimerWheel::~TimerWheel() {
+  // NOTE: the timers belong to their owners, only unlink them
+  uint32_t eflags = lock.Lock();
+  for (uint32_t level = 0; level < LEVELS; level++)
+    for (uint32_t slot = 0; slot < SLOTS; slot++)
+      while (wheel[level][slot] != 0) Unlink(wheel[level][slot]);
+  while (expired != 0) Unlink(expired);
+  lock.Unlock(eflags);
+}
+
+
+/**
+ * [links the timer into the slot for its expiry tick, the lock must be held]
+ * the level is picked by how far away the expiry is, the slot by the expiry bits of that level
+ */
+void TimerWheel::Insert(Timer* timer) {
+  uint32_t delta = timer->expires - currentTick;
+  uint32_t level = 0;
+  while (level < LEVELS - 1 && delta >= (1u << ((level + 1) * SLOT_BITS))) level++;
+
+  Timer** slot = &wheel[level][(timer->expires >> (level * SLOT_BITS)) & (SLOTS - 1)];
+  timer->next = *slot;
+  if (*slot != 0) (*slot)->pprev = &timer->next;
+  timer->pprev = slot;
+  *slot = timer;
+}
+
+
+/**
+ * [removes a pending timer from its slot or the expired list in O(1), the lock must be held]
+ */
+void TimerWheel::Unlink(Timer* timer) {
+  if (timer->next != 0)
+    timer->next->pprev = timer->pprev;
+  else if (expiredTail == &timer->next)
+    expiredTail = timer->pprev;
+  *timer->pprev = timer->next;
+  timer->next = 0;
+  timer->pprev = 0;
+  pending--;
+}
+
+
+/**
+ * [re-inserts every timer of wheel[level][index], they land on lower levels now that they are closer]
+ * returns index, 0 := the level above has to cascade too
+ */
+uint32_t TimerWheel::Cascade(uint32_t level, uint32_t index) {
+  Timer* timer = wheel[level][index];
+  wheel[level][index] = 0;
+
+  while (timer != 0) {
+    Timer* next = timer->next;
+    Insert(timer);
+    timer = next;
+  }
+  return index;
+}
+
+
+/**
+ * [starts timer, its callback runs after delay ticks]
+ * NOTE: callable from interrupt handlers, deferred work and tasks
+ */
+void TimerWheel::Add(Timer* timer, uint32_t delay) {
+  if (delay == 0) delay = 1;
+  if (delay > MAX_DELAY) delay = MAX_DELAY;
+
+  uint32_t eflags = lock.Lock();
+  if (timer->pprev != 0) Unlink(timer);
+  timer->expires = currentTick + delay;
+  Insert(timer);
+  pending++;
+  lock.Unlock(eflags);
+}
+
+
+/**
+ * [stops a pending timer, also one that has fired but whose callback has not run yet]
+ */
+bool TimerWheel::Cancel(Timer* timer) {
+  uint32_t eflags = lock.Lock();
+  bool wasPending = timer->pprev != 0;
+  if (wasPending) Unlink(timer);
+  lock.Unlock(eflags);
+  return wasPending;
+}
+
+
+/**
+ * [advances the wheel by one tick, called by the timer interrupt]
+ * moves the due slot to the expired list and defers the callbacks
+ */
+void TimerWheel::Tick() {
+  uint32_t eflags = lock.Lock();
+  currentTick++;
+
+  uint32_t index = currentTick & (SLOTS - 1);
+  for (uint32_t level = 1; index == 0 && level < LEVELS; level++)
+    index = Cascade(level, (currentTick >> (level * SLOT_BITS)) & (SLOTS - 1));
+
+  Timer** slot = &wheel[0][currentTick & (SLOTS - 1)];
+  bool run = false;
+  if (*slot != 0) {
+    Splice(slot);
+    run = !runScheduled;  // NOTE: a run already scheduled takes these too
+    runScheduled = true;
+  }
+  lock.Unlock(eflags);
+
+  if (run && !InterruptManager::Defer(&RunExpired, this)) RunExpired(this);
+}
+
+
+/**
+ * [moves the whole slot onto the expired list, the lock must be held]
+ */
+void TimerWheel::Splice(Timer** slot) {
+  *expiredTail = *slot;
+  (*slot)->pprev = expiredTail;
+  while (*expiredTail != 0) expiredTail = &(*expiredTail)->next;
+  *slot = 0;
+}
+
+
+/**
+ * [deferred work, runs the callbacks of the expired timers]
+ */
+void TimerWheel::RunExpired(void* timerWheel) {
+  TimerWheel* self = (TimerWheel*)timerWheel;
+
+  while (true) {
+    uint32_t eflags = self->lock.Lock();
+    Timer* timer = self->expired;
+    if (timer == 0) {
+      self->runScheduled = false;
+      self->lock.Unlock(eflags);
+      break;
+    }
+    self->Unlink(timer);
+    self->lock.Unlock(eflags);
+
+    // NOTE: unlinked first, so the callback can add the timer again
+    timer->function(timer->argument);
+  }
+}
+
+
+/**
+ * [ticks until the earliest timer that may be due, looks at level 0 only]
+ * a timer on a higher level is due after the next cascade at the earliest, so that bounds the result
+ */
+uint32_t TimerWheel::GetTicksUntilNextTimer() {
+  if (pending == 0) return 0xFFFFFFFF;
+
+  uint32_t eflags = lock.Lock();
+  uint32_t nextCascade = SLOTS - (currentTick & (SLOTS - 1));
+  uint32_t ticksLeft = nextCascade;
+  for (uint32_t ticks = 1; ticks < nextCascade && ticksLeft == nextCascade; ticks++)
+    if (wheel[0][(currentTick + ticks) & (SLOTS - 1)] != 0) ticksLeft = ticks;
+  lock.Unlock(eflags);
+  return ticksLeft;
+}
+
+
+uint32_t TimerWheel::GetPending() {
+  return pending;
+}
+
+
+uint32_t TimerWheel::GetCurrentTick() {
+  return currentTick;
+}
+
+
+LockStats TimerWheel::GetLockStats() {
+  return lock.GetStats();
+}
@@ -1,24 +1,82 @@
+#include <fpu.h>
 #include <utils/memory.h>
 
-#include <system_error>
-
 using namespace os;
 using namespace os::common;
 using namespace os::utils;
 
+/* NOTE: size classes, picked per call:
+ * - below REP_MIN bytes a plain byte loop, the rep setup costs more than it saves
+ * - from REP_MIN on "rep movsl"/"rep stosl", 4 bytes per step, the last n % 4 bytes with "rep movsb"
+ * - from SSE_MIN on, if src and dest are aligned alike mod 16, SSE2 64-byte blocks (memcpy only)
+ */
+static const size_t REP_MIN = 16;
+static const size_t SSE_MIN = 1024;
+static const size_t SSE_CHUNK = 16 * 1024;  // per FPU::Begin(), bounds the time with interrupts off
+
+
+static inline void CopyForward(uint8_t* d, const uint8_t* s, size_t n) {
+  size_t words = n >> 2;
+  size_t bytes = n & 3;
+  asm volatile("rep movsl" : "+D"(d), "+S"(s), "+c"(words) : : "memory");
+  asm volatile("rep movsb" : "+D"(d), "+S"(s), "+c"(bytes) : : "memory");
+}
+
+
+/**
+ * [copies n bytes (a multiple of 64) between 16-byte aligned buffers through the xmm registers]
+ * PERFORMANCE: 4 aligned 16-byte loads, then 4 stores per round
+ */
+static void CopySSE(uint8_t* d, const uint8_t* s, size_t n) {
+  while (n > 0) {
+    size_t chunk = (n < SSE_CHUNK) ? n : SSE_CHUNK;
+    uint32_t eflags = FPU::Begin();
+    for (size_t i = 0; i < chunk; i += 64)
+      asm volatile(
+          "movdqa   (%0), %%xmm0\n"
+          "movdqa 16(%0), %%xmm1\n"
+          "movdqa 32(%0), %%xmm2\n"
+          "movdqa 48(%0), %%xmm3\n"
+          "movdqa %%xmm0,   (%1)\n"
+          "movdqa %%xmm1, 16(%1)\n"
+          "movdqa %%xmm2, 32(%1)\n"
+          "movdqa %%xmm3, 48(%1)\n"
+          :
+          : "r"(s + i), "r"(d + i)
+          : "memory"
+      );
+    FPU::End(eflags);
+
+    d += chunk;
+    s += chunk;
+    n -= chunk;
+  }
+}
+
+
 namespace os {
 namespace utils {
 // moves memory, handles overlapping memory regions, slower, returns destination memory Chunk
 void* memmove(void* dest, const void* src, common::size_t n) {
   uint8_t* d = (uint8_t*)dest;
   const uint8_t* s = (const uint8_t*)src;
-  if (d < s) {
-    while (n--) *d++ = *s++;
-  } else {
-    d += n;
-    s += n;
+
+  // NOTE: a forward copy is safe unless dest starts inside src
+  if (d <= s || d >= s + n) return memcpy(dest, src, n);
+
+  d += n;
+  s += n;
+  if (n < REP_MIN) {
     while (n--) *--d = *--s;
+    return dest;
   }
+
+  // backward: the n % 4 bytes at the end first, then whole words from the top down
+  for (size_t bytes = n & 3; bytes > 0; bytes--) *--d = *--s;
+  size_t words = n >> 2;
+  d -= 4;
+  s -= 4;
+  asm volatile("std; rep movsl; cld" : "+D"(d), "+S"(s), "+c"(words) : : "memory");
   return dest;
 }
 
@@ -28,7 +86,27 @@ void* memmove(void* dest, const void* src, common::size_t n) {
 void* memcpy(void* dest, const void* src, common::size_t n) {
   uint8_t* d = (uint8_t*)dest;
   const uint8_t* s = (const uint8_t*)src;
-  while (n--) *d++ = *s++;
+
+  if (n < REP_MIN) {
+    while (n--) *d++ = *s++;
+    return dest;
+  }
+
+  if (n >= SSE_MIN && FPU::HasSSE() && (((uintptr_t)d ^ (uintptr_t)s) & 15) == 0) {
+    size_t head = (16 - ((uintptr_t)d & 15)) & 15;
+    CopyForward(d, s, head);
+    d += head;
+    s += head;
+    n -= head;
+
+    size_t blocks = n & ~(size_t)63;
+    CopySSE(d, s, blocks);
+    d += blocks;
+    s += blocks;
+    n -= blocks;
+  }
+
+  CopyForward(d, s, n);
   return dest;
 }
 
@@ -39,7 +117,16 @@ void* memcpy(void* dest, const void* src, common::size_t n) {
  */
 void* memset(void* ptr, int value, common::size_t n) {
   uint8_t* p = (uint8_t*)ptr;
-  while (n--) *p++ = (uint8_t)value;
+  if (n < REP_MIN) {
+    while (n--) *p++ = (uint8_t)value;
+    return ptr;
+  }
+
+  uint32_t pattern = (uint8_t)value * 0x01010101u;
+  size_t words = n >> 2;
+  size_t bytes = n & 3;
+  asm volatile("rep stosl" : "+D"(p), "+c"(words) : "a"(pattern) : "memory");
+  asm volatile("rep stosb" : "+D"(p), "+c"(bytes) : "a"(pattern) : "memory");
   return ptr;
 }
 
@@ -50,10 +137,16 @@ void* memset(void* ptr, int value, common::size_t n) {
  * @param ptr2 [voidptr: memChunk 2]
  * @param n [size_t: how many bytes to compare]
  * @return [return int: < 0, 0, > 0]
+ * PERFORMANCE: 4 bytes per step while they are equal, the bytes of the first differing word decide
  */
 int memcmp(const void* ptr1, const void* ptr2, common::size_t n) {
   const uint8_t* p1 = (const uint8_t*)ptr1;
   const uint8_t* p2 = (const uint8_t*)ptr2;
+  while (n >= 4 && *(const uint32_t*)p1 == *(const uint32_t*)p2) {
+    p1 += 4;
+    p2 += 4;
+    n -= 4;
+  }
   while (n--) {
     if (*p1 != *p2) return *p1 - *p2;
     p1++;
@@ -0,0 +1,126 @@
+#include <hardwarecommunication/interrupts.h>
+#include <workqueue.h>
+
+using namespace os;
+using namespace os::common;
+using namespace os::hardwarecommunication;
+
+WorkQueue* WorkQueue::activeWorkQueue = 0;
+
+
+/**
+ * [starts numWorkers kernel threads (at most MAX_WORKERS) of the given priority that service the queue]
+ */
+WorkQueue::WorkQueue(TaskManager* taskManager, uint32_t numWorkers, uint8_t priority) {
+  activeWorkQueue = this;
+  this->taskManager = taskManager;
+  head = 0;
+  tail = 0;
+  dropped = 0;
+  numIdle = 0;
+  stopping = false;
+
+  if (numWorkers > MAX_WORKERS) numWorkers = MAX_WORKERS;
+  this->numWorkers = 0;
+  for (uint32_t i = 0; i < numWorkers; i++) {
+    Task* worker = taskManager->CreateThread(&WorkerMain, this, priority);
+    if (worker == 0) break;
+    workers[this->numWorkers++] = worker;
+  }
+}
+
+
+WorkQueue::~WorkQueue() {
+  if (activeWorkQueue == this) activeWorkQueue = 0;
+  stopping = true;
+  for (uint32_t i = 0; i < numWorkers; i++) taskManager->Wake(workers[i]);
+  for (uint32_t i = 0; i < numWorkers; i++) taskManager->Join(workers[i]);
+}
+
+
+/**
+ * [queues function(argument) for the next idle worker, FIFO order]
+ * NOTE: callable from interrupt handlers, deferred work and tasks
+ */
+bool WorkQueue::Queue(void (*function)(void*), void* argument) {
+  if (numWorkers == 0) return false;
+
+  uint32_t eflags = lock.Lock();
+  uint32_t next = (tail + 1) & (MAX_WORK - 1);
+  if (next == head || stopping) {
+    dropped++;
+    lock.Unlock(eflags);
+    return false;
+  }
+
+  work[tail].function = function;
+  work[tail].argument = argument;
+  tail = next;
+
+  // NOTE: one idle worker is enough, a busy one takes the next job itself when it is done
+  Task* worker = (numIdle > 0) ? idle[--numIdle] : 0;
+  lock.Unlock(eflags);
+
+  if (worker != 0) taskManager->Wake(worker);
+  return true;
+}
+
+
+/**
+ * [worker thread, runs jobs until the queue is empty and stopping is set]
+ */
+void WorkQueue::WorkerMain(void* queue) {
+  WorkQueue* self = (WorkQueue*)queue;
+  Task* current = self->taskManager->GetCurrentTask();
+
+  while (true) {
+    asm volatile("cli");
+    uint32_t eflags = self->lock.Lock();
+    if (self->head == self->tail) {
+      if (self->stopping) {
+        self->lock.Unlock(eflags);
+        break;
+      }
+
+      // NOTE: still listed if a stale pending Wake() let Block() return without a Queue()
+      bool listed = false;
+      for (uint32_t i = 0; i < self->numIdle; i++) listed |= self->idle[i] == current;
+      if (!listed) self->idle[self->numIdle++] = current;
+      self->lock.Unlock(eflags);
+
+      // NOTE: interrupts stay disabled. a Queue() on another CPU between the unlock and the switch
+      // leaves a pending Wake(), Block() then returns right away
+      self->taskManager->Block();
+      continue;
+    }
+
+    Work job = self->work[self->head];
+    self->head = (self->head + 1) & (MAX_WORK - 1);
+    self->lock.Unlock(eflags);
+    asm volatile("sti");
+
+    job.function(job.argument);
+  }
+
+  asm volatile("sti");
+}
+
+
+uint32_t WorkQueue::GetPending() {
+  return (tail - head) & (MAX_WORK - 1);
+}
+
+
+uint32_t WorkQueue::GetDropped() {
+  return dropped;
+}
+
+
+uint32_t WorkQueue::GetWorkers() {
+  return numWorkers;
+}
+
+
+LockStats WorkQueue::GetLockStats() {
+  return lock.GetStats();
+}
@@ -0,0 +1,66 @@
+#ifndef __OS__TESTS__HARNESS_H
+#define __OS__TESTS__HARNESS_H
+
+// NOTE: host side only, the tests build kernel sources natively and compare them against libc
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+namespace tests {
+
+inline int failures = 0;
+inline volatile int sink;    // keeps results of benchmarked calls alive
+inline bool useSSE = true;  // FPU::HasSSE() of the host stub (stubs/fpu.h)
+
+/** [counts and prints a failed check, the test keeps going] */
+#define CHECK(condition, ...)                                \
+  do {                                                       \
+    if (!(condition)) {                                      \
+      if (tests::failures++ < 20) {                          \
+        printf("FAIL %s:%d: ", __FILE__, __LINE__);          \
+        printf(__VA_ARGS__);                                 \
+        printf("\n");                                        \
+      }                                                      \
+    }                                                        \
+  } while (0)
+
+
+/** [-1, 0 or 1, memcmp/strcmp only promise the sign] */
+inline int Sign(int x) {
+  return (x > 0) - (x < 0);
+}
+
+/** [monotonic clock in seconds] */
+inline double Now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/** [repeats as often as needed to move about 256 MiB, at least 16 times] */
+inline unsigned long Rounds(unsigned long bytes) {
+  unsigned long rounds = (256ul << 20) / (bytes + 1);
+  return (rounds < 16) ? 16 : rounds;
+}
+
+/** [runs fn(n) Rounds(n) times and returns the throughput in MiB/s] */
+template <typename Fn>
+double Throughput(unsigned long n, Fn fn) {
+  unsigned long rounds = Rounds(n);
+  double start = Now();
+  for (unsigned long i = 0; i < rounds; i++) fn(n);
+  double elapsed = Now() - start;
+  return (double)n * rounds / (1 << 20) / elapsed;
+}
+
+/** [prints the summary line and returns the exit code] */
+inline int Finish(const char* name) {
+  if (failures == 0) printf("%s: all checks passed\n", name);
+  else printf("%s: %d check(s) failed\n", name, failures);
+  return (failures == 0) ? 0 : 1;
+}
+
+}  // namespace tests
+
+#endif
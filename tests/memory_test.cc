@@ -0,0 +1,209 @@
+#include <string.h>
+#include <utils/memory.h>
+
+#include "harness.h"
+
+// NOTE: src/utils/memory.cc built for the host, checked against libc and the byte loops it replaced
+
+namespace ref {
+
+/** [the byte loops memory.cc used before the size classes, the baseline for the benchmark] */
+void* memmove(void* dest, const void* src, unsigned long n) {
+  unsigned char* d = (unsigned char*)dest;
+  const unsigned char* s = (const unsigned char*)src;
+  if (d < s) {
+    while (n--) *d++ = *s++;
+  } else {
+    d += n;
+    s += n;
+    while (n--) *--d = *--s;
+  }
+  return dest;
+}
+
+void* memcpy(void* dest, const void* src, unsigned long n) {
+  unsigned char* d = (unsigned char*)dest;
+  const unsigned char* s = (const unsigned char*)src;
+  while (n--) *d++ = *s++;
+  return dest;
+}
+
+void* memset(void* ptr, int value, unsigned long n) {
+  unsigned char* p = (unsigned char*)ptr;
+  while (n--) *p++ = (unsigned char)value;
+  return ptr;
+}
+
+int memcmp(const void* ptr1, const void* ptr2, unsigned long n) {
+  const unsigned char* p1 = (const unsigned char*)ptr1;
+  const unsigned char* p2 = (const unsigned char*)ptr2;
+  while (n--) {
+    if (*p1 != *p2) return *p1 - *p2;
+    p1++;
+    p2++;
+  }
+  return 0;
+}
+
+}  // namespace ref
+
+
+static const unsigned long MAX_SIZE = 1 << 20;
+static const unsigned long SLACK = 256;  // room for offsets and the guard bytes behind the data
+
+static unsigned char src[MAX_SIZE + SLACK];
+static unsigned char dst[MAX_SIZE + SLACK];
+static unsigned char expected[MAX_SIZE + SLACK];
+
+
+/** [random bytes, half of them with the high bit set] */
+static void Fill(unsigned char* buffer, unsigned long n) {
+  for (unsigned long i = 0; i < n; i++) buffer[i] = (unsigned char)rand();
+}
+
+/** [sizes around every size class boundary of memory.cc (16, 1024, 16 KiB) plus a few large ones] */
+static const unsigned long SIZES[] = {
+    0,     1,     2,     3,     4,     5,     7,     8,     15,    16,      17,      31,
+    32,    33,    63,    64,    65,    127,   255,   256,   257,   1000,    1023,    1024,
+    1025,  1087,  1088,  1089,  4095,  4096,  4097,  16383, 16384, 16385,   16447,   65536,
+    65539, 99999, 262144, 524287, MAX_SIZE - 1, MAX_SIZE};
+static const int SIZE_COUNT = sizeof(SIZES) / sizeof(SIZES[0]);
+
+
+static void TestMemcpy() {
+  for (int i = 0; i < SIZE_COUNT; i++) {
+    unsigned long n = SIZES[i];
+    int step = (n > 4096) ? 5 : 1;  // NOTE: every offset pair for small sizes, a sample for large ones
+    for (int so = 0; so < 20; so += step) {
+      for (int doff = 0; doff < 20; doff += step) {
+        Fill(src, n + SLACK);
+        Fill(dst, n + SLACK);
+        ::memcpy(expected, dst, n + SLACK);
+        ::memcpy(expected + doff, src + so, n);
+
+        void* result = os::utils::memcpy(dst + doff, src + so, n);
+        CHECK(result == dst + doff, "memcpy n=%lu: wrong return value", n);
+        CHECK(::memcmp(dst, expected, n + SLACK) == 0, "memcpy n=%lu src+%d dst+%d", n, so, doff);
+      }
+    }
+  }
+}
+
+
+static void TestMemmove() {
+  for (int i = 0; i < SIZE_COUNT; i++) {
+    unsigned long n = SIZES[i];
+    if (n + 64 > MAX_SIZE) continue;
+    // NOTE: distances below 4 overlap inside one word, 64 covers a whole SSE block
+    static const int DISTANCES[] = {0, 1, 2, 3, 4, 5, 15, 16, 17, 63, 64};
+    for (int d = 0; d < (int)(sizeof(DISTANCES) / sizeof(DISTANCES[0])); d++) {
+      for (int forward = 0; forward < 2; forward++) {
+        unsigned long from = forward ? DISTANCES[d] : 0;
+        unsigned long to = forward ? 0 : DISTANCES[d];
+        Fill(dst, n + SLACK);
+        ::memcpy(expected, dst, n + SLACK);
+        ::memmove(expected + to, expected + from, n);
+
+        void* result = os::utils::memmove(dst + to, dst + from, n);
+        CHECK(result == dst + to, "memmove n=%lu: wrong return value", n);
+        CHECK(::memcmp(dst, expected, n + SLACK) == 0, "memmove n=%lu from %lu to %lu", n, from, to);
+      }
+    }
+  }
+}
+
+
+static void TestMemset() {
+  static const int VALUES[] = {0, 1, 0x7F, 0x80, 0xA5, 0xFF, -1, 0x1234};  // only the low byte counts
+  for (int i = 0; i < SIZE_COUNT; i++) {
+    unsigned long n = SIZES[i];
+    for (int v = 0; v < (int)(sizeof(VALUES) / sizeof(VALUES[0])); v++) {
+      for (int offset = 0; offset < 4; offset++) {
+        Fill(dst, n + SLACK);
+        ::memcpy(expected, dst, n + SLACK);
+        ::memset(expected + offset, VALUES[v], n);
+
+        void* result = os::utils::memset(dst + offset, VALUES[v], n);
+        CHECK(result == dst + offset, "memset n=%lu: wrong return value", n);
+        CHECK(::memcmp(dst, expected, n + SLACK) == 0, "memset n=%lu value 0x%x +%d", n, VALUES[v],
+              offset);
+      }
+    }
+  }
+}
+
+
+static void TestMemcmp() {
+  for (int i = 0; i < SIZE_COUNT; i++) {
+    unsigned long n = SIZES[i];
+    if (n > 65536) continue;
+    Fill(src, n + SLACK);
+    for (int offset = 0; offset < 4; offset++) {
+      ::memcpy(dst + offset, src + offset, n);
+      CHECK(os::utils::memcmp(src + offset, dst + offset, n) == 0, "memcmp n=%lu equal +%d", n, offset);
+
+      // NOTE: one differing byte at every position of small sizes, the high bit decides unsigned order
+      unsigned long stride = (n > 300) ? 97 : 1;
+      for (unsigned long at = 0; at < n; at += stride) {
+        unsigned char saved = dst[offset + at];
+        dst[offset + at] = saved ^ 0x80;
+        int want = tests::Sign(::memcmp(src + offset, dst + offset, n));
+        int got = tests::Sign(os::utils::memcmp(src + offset, dst + offset, n));
+        CHECK(got == want, "memcmp n=%lu differs at %lu: %d instead of %d", n, at, got, want);
+        dst[offset + at] = saved;
+      }
+    }
+  }
+}
+
+
+static void Benchmark() {
+  static const unsigned long BENCH_SIZES[] = {8, 64, 512, 4096, 65536, MAX_SIZE};
+  printf("\nthroughput in MiB/s (byte loop / memory.cc / libc)\n");
+  printf("%8s %26s %26s %26s %26s\n", "size", "memcpy", "memmove (overlap)", "memset", "memcmp");
+
+  Fill(src, MAX_SIZE + SLACK);
+  ::memcpy(dst, src, MAX_SIZE + SLACK);
+  for (int i = 0; i < (int)(sizeof(BENCH_SIZES) / sizeof(BENCH_SIZES[0])); i++) {
+    unsigned long n = BENCH_SIZES[i];
+    double cpy[3], move[3], set[3], cmp[3];
+
+    cpy[0] = tests::Throughput(n, [](unsigned long n) { ref::memcpy(dst, src, n); });
+    cpy[1] = tests::Throughput(n, [](unsigned long n) { os::utils::memcpy(dst, src, n); });
+    cpy[2] = tests::Throughput(n, [](unsigned long n) { ::memcpy(dst, src, n); });
+
+    move[0] = tests::Throughput(n, [](unsigned long n) { ref::memmove(dst + 8, dst, n); });
+    move[1] = tests::Throughput(n, [](unsigned long n) { os::utils::memmove(dst + 8, dst, n); });
+    move[2] = tests::Throughput(n, [](unsigned long n) { ::memmove(dst + 8, dst, n); });
+
+    set[0] = tests::Throughput(n, [](unsigned long n) { ref::memset(dst, 0xA5, n); });
+    set[1] = tests::Throughput(n, [](unsigned long n) { os::utils::memset(dst, 0xA5, n); });
+    set[2] = tests::Throughput(n, [](unsigned long n) { ::memset(dst, 0xA5, n); });
+
+    ::memcpy(dst, src, n);
+    cmp[0] = tests::Throughput(n, [](unsigned long n) { tests::sink = ref::memcmp(dst, src, n); });
+    cmp[1] = tests::Throughput(n, [](unsigned long n) { tests::sink = os::utils::memcmp(dst, src, n); });
+    cmp[2] = tests::Throughput(n, [](unsigned long n) { tests::sink = ::memcmp(dst, src, n); });
+
+    printf("%8lu %8.0f %8.0f %8.0f %8.0f %8.0f %8.0f %8.0f %8.0f %8.0f %8.0f %8.0f %8.0f\n", n, cpy[0],
+           cpy[1], cpy[2], move[0], move[1], move[2], set[0], set[1], set[2], cmp[0], cmp[1], cmp[2]);
+  }
+}
+
+
+int main(int argc, char** argv) {
+  srand(1);
+  for (int sse = 1; sse >= 0; sse--) {
+    tests::useSSE = sse;
+    TestMemcpy();
+    TestMemmove();
+    TestMemset();
+    TestMemcmp();
+  }
+
+  if (argc > 1 && strcmp(argv[1], "bench") == 0) {
+    tests::useSSE = true;
+    Benchmark();
+  }
+  return tests::Finish("memory_test");
+}
@@ -0,0 +1,196 @@
+#include <string.h>
+#include <utils/string.h>
+
+#include "harness.h"
+
+// NOTE: src/utils/string.cc built for the host, checked against libc and the byte loops it replaced
+
+namespace ref {
+
+/** [the byte loops string.cc used before word-at-a-time scanning, the baseline for the benchmark] */
+unsigned strlen(const char* str) {
+  unsigned len = 0;
+  while (str[len] != 0) len++;
+  return len;
+}
+
+int strcmp(const char* str1, const char* str2) {
+  while (*str1 && (*str1 == *str2)) {
+    str1++;
+    str2++;
+  }
+  return *(const unsigned char*)str1 - *(const unsigned char*)str2;
+}
+
+char* strchr(const char* str, int character) {
+  while (*str != (char)character) {
+    if (!*str++) return 0;
+  }
+  return (char*)str;
+}
+
+}  // namespace ref
+
+
+static const int MAX_LENGTH = 1 << 16;
+static const int SLACK = 64;  // alignment offsets and the bytes behind the terminator
+
+static char a[MAX_LENGTH + SLACK];
+static char b[MAX_LENGTH + SLACK];
+
+
+/** [length non-zero bytes at buffer + offset and a terminator, high-bit bytes if highBit] */
+static char* MakeString(char* buffer, int offset, int length, bool highBit) {
+  char* s = buffer + offset;
+  for (int i = 0; i < length; i++) {
+    int c = highBit ? rand() % 255 + 1 : rand() % 127 + 1;
+    s[i] = (char)c;
+  }
+  s[length] = 0;
+  // NOTE: garbage behind the terminator, the word reads must not take it for part of the string
+  for (int i = 1; i < 8; i++) s[length + i] = (char)(rand() % 255 + 1);
+  return s;
+}
+
+
+static void TestStrlen() {
+  for (int length = 0; length < 300; length++) {
+    for (int offset = 0; offset < 4; offset++) {
+      for (int highBit = 0; highBit < 2; highBit++) {
+        char* s = MakeString(a, offset, length, highBit);
+        CHECK(os::utils::strlen(s) == strlen(s), "strlen %d +%d high %d", length, offset, highBit);
+      }
+    }
+  }
+}
+
+
+static void TestStrcmp() {
+  for (int length = 0; length < 70; length++) {
+    for (int offset1 = 0; offset1 < 4; offset1++) {
+      for (int offset2 = 0; offset2 < 4; offset2++) {
+        for (int highBit = 0; highBit < 2; highBit++) {
+          char* s1 = MakeString(a, offset1, length, highBit);
+          char* s2 = b + offset2;
+          memcpy(s2, s1, length + 1);
+          CHECK(os::utils::strcmp(s1, s2) == 0, "strcmp equal %d +%d +%d", length, offset1, offset2);
+          CHECK(os::utils::strncmp(s1, s2, length + 5) == 0, "strncmp equal %d", length);
+
+          // NOTE: every position differs once, by a high-bit byte, a low byte or an early terminator
+          for (int at = 0; at < length; at++) {
+            char saved = s2[at];
+            static const char REPLACEMENTS[] = {(char)0x80, (char)0xFF, 0x01, 0x7F, 0};
+            for (int r = 0; r < (int)sizeof(REPLACEMENTS); r++) {
+              if (REPLACEMENTS[r] == saved) continue;
+              s2[at] = REPLACEMENTS[r];
+              int want = tests::Sign(strcmp(s1, s2));
+              int got = tests::Sign(os::utils::strcmp(s1, s2));
+              CHECK(got == want, "strcmp %d +%d +%d differs at %d (0x%02x)", length, offset1, offset2,
+                    at, (unsigned char)REPLACEMENTS[r]);
+
+              for (int n = at - 1; n <= at + 5; n += 3) {
+                if (n < 0) continue;
+                want = tests::Sign(strncmp(s1, s2, n));
+                got = tests::Sign(os::utils::strncmp(s1, s2, n));
+                CHECK(got == want, "strncmp %d n=%d differs at %d", length, n, at);
+              }
+            }
+            s2[at] = saved;
+          }
+        }
+      }
+    }
+  }
+}
+
+
+static void TestStrchr() {
+  for (int length = 0; length < 70; length++) {
+    for (int offset = 0; offset < 4; offset++) {
+      for (int highBit = 0; highBit < 2; highBit++) {
+        char* s = MakeString(a, offset, length, highBit);
+
+        // NOTE: 0 finds the terminator; 0x80.. as int and as negative char both mean the same byte
+        CHECK(os::utils::strchr(s, 0) == s + length, "strchr(s, 0) %d +%d", length, offset);
+        static const int CHARACTERS[] = {1, 'a', 0x7F, 0x80, 0xC3, 0xFF, -1, (char)0x80, 0x141};
+        for (int c = 0; c < (int)(sizeof(CHARACTERS) / sizeof(CHARACTERS[0])); c++) {
+          CHECK(os::utils::strchr(s, CHARACTERS[c]) == strchr(s, CHARACTERS[c]), "strchr %d +%d 0x%x",
+                length, offset, CHARACTERS[c]);
+        }
+        // a character at every position, the first occurrence wins
+        for (int at = 0; at < length; at++) {
+          CHECK(os::utils::strchr(s, s[at]) == strchr(s, s[at]), "strchr %d +%d at %d", length, offset,
+                at);
+          CHECK(os::utils::strchr(s, (unsigned char)s[at]) == strchr(s, (unsigned char)s[at]),
+                "strchr unsigned %d +%d at %d", length, offset, at);
+        }
+      }
+    }
+  }
+}
+
+
+static void TestStrtok() {
+  char mine[64], libc[64];
+  static const char* LINES[] = {"", "   ", "ping 10.0.2.2", "  a  b\tc  ", "a,,b;c", "\xc3\xa9 x\xff y"};
+  static const char* DELIMITERS[] = {" ", " \t", ",;", "\xff "};
+  for (int l = 0; l < (int)(sizeof(LINES) / sizeof(LINES[0])); l++) {
+    for (int d = 0; d < (int)(sizeof(DELIMITERS) / sizeof(DELIMITERS[0])); d++) {
+      strcpy(mine, LINES[l]);
+      strcpy(libc, LINES[l]);
+      char* got = os::utils::strtok(mine, DELIMITERS[d]);
+      char* want = strtok(libc, DELIMITERS[d]);
+      while (true) {
+        CHECK((got == 0) == (want == 0), "strtok \"%s\" by \"%s\"", LINES[l], DELIMITERS[d]);
+        if (got == 0 || want == 0) break;
+        CHECK(got - mine == want - libc && strcmp(got, want) == 0,
+              "strtok \"%s\": \"%s\" instead of \"%s\"", LINES[l], got, want);
+        got = os::utils::strtok(0, DELIMITERS[d]);
+        want = strtok(0, DELIMITERS[d]);
+      }
+    }
+  }
+}
+
+
+static void Benchmark() {
+  static const int BENCH_LENGTHS[] = {8, 64, 512, 4096, MAX_LENGTH - 1};
+  printf("\nthroughput in MiB/s (byte loop / string.cc / libc)\n");
+  printf("%8s %26s %26s %26s\n", "length", "strlen", "strcmp (equal)", "strchr (absent)");
+
+  for (int i = 0; i < (int)(sizeof(BENCH_LENGTHS) / sizeof(BENCH_LENGTHS[0])); i++) {
+    int length = BENCH_LENGTHS[i];
+    char* s1 = MakeString(a, 0, length, false);
+    memcpy(b, s1, length + 1);
+    double len[3], cmp[3], chr[3];
+
+    len[0] = tests::Throughput(length, [](unsigned long) { tests::sink = ref::strlen(a); });
+    len[1] = tests::Throughput(length, [](unsigned long) { tests::sink = os::utils::strlen(a); });
+    len[2] = tests::Throughput(length, [](unsigned long) { tests::sink = strlen(a); });
+
+    cmp[0] = tests::Throughput(length, [](unsigned long) { tests::sink = ref::strcmp(a, b); });
+    cmp[1] = tests::Throughput(length, [](unsigned long) { tests::sink = os::utils::strcmp(a, b); });
+    cmp[2] = tests::Throughput(length, [](unsigned long) { tests::sink = strcmp(a, b); });
+
+    // NOTE: 0x80 never occurs in MakeString(..., false), the whole string is scanned
+    chr[0] = tests::Throughput(length, [](unsigned long) { tests::sink = ref::strchr(a, 0x80) != 0; });
+    chr[1] =
+        tests::Throughput(length, [](unsigned long) { tests::sink = os::utils::strchr(a, 0x80) != 0; });
+    chr[2] = tests::Throughput(length, [](unsigned long) { tests::sink = strchr(a, 0x80) != 0; });
+
+    printf("%8d %8.0f %8.0f %8.0f %8.0f %8.0f %8.0f %8.0f %8.0f %8.0f\n", length, len[0], len[1], len[2],
+           cmp[0], cmp[1], cmp[2], chr[0], chr[1], chr[2]);
+  }
+}
+
+
+int main(int argc, char** argv) {
+  srand(1);
+  TestStrlen();
+  TestStrcmp();
+  TestStrchr();
+  TestStrtok();
+
+  if (argc > 1 && strcmp(argv[1], "bench") == 0) Benchmark();
+  return tests::Finish("string_test");
+}
@@ -0,0 +1,28 @@
+#ifndef __OS__FPU_H
+#define __OS__FPU_H
+
+#include <common/types.h>
+
+// NOTE: stands in for include/fpu.h on the host, which may always use SSE. the tests switch
+// tests::useSSE off to cover the paths without it
+
+namespace tests {
+extern bool useSSE;
+}
+
+namespace os {
+
+class FPU {
+ public:
+  static bool HasSSE() {
+    return tests::useSSE;
+  }
+  static common::uint32_t Begin() {
+    return 0;
+  }
+  static void End(common::uint32_t eflags) {}
+};
+
+}  // namespace os
+
+#endif